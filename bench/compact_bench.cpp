@@ -0,0 +1,92 @@
+#include <a0.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "a0/logger/compact.hpp"
+
+// Compares logfile write rate with the compact encoding against the default.
+//
+// Packets carry the headers a Publisher adds. Each is written to a logfile in
+// /dev/shm, as the logger writes it, after encoding if compact. MiB/s counts
+// packets as received, before encoding.
+//
+// Usage: bin/bench_compact [packets]
+
+static std::string make_uuid(std::mt19937_64& rng) {
+  static const char* kHex = "0123456789abcdef";
+  std::string out;
+  for (int i = 0; i < 32; i++) {
+    if (i == 8 || i == 12 || i == 16 || i == 20) {
+      out.push_back('-');
+    }
+    out.push_back(kHex[rng() % 16]);
+  }
+  return out;
+}
+
+static std::vector<a0::Packet> make_packets(size_t payload_size, std::mt19937_64& rng) {
+  auto writer_id = make_uuid(rng);
+  auto publisher_id = make_uuid(rng);
+  std::vector<a0::Packet> pkts;
+  for (int i = 0; i < 256; i++) {
+    pkts.push_back(a0::Packet(
+        {
+            {"a0_time_mono", a0::TimeMono::now().to_string()},
+            {"a0_time_wall", a0::TimeWall::now().to_string()},
+            {"a0_transport_seq", std::to_string(i)},
+            {"a0_writer_seq", std::to_string(i)},
+            {"a0_writer_id", writer_id},
+            {"a0_publisher_seq", std::to_string(i)},
+            {"a0_publisher_id", publisher_id},
+        },
+        std::string(payload_size, 'x')));
+  }
+  return pkts;
+}
+
+int main(int argc, char** argv) {
+  int num_pkts = argc > 1 ? std::stoi(argv[1]) : 1000000;
+  const std::string path = "/dev/shm/bench_compact.a0";
+
+  std::mt19937_64 rng(0);
+  printf("%8s %10s %12s %10s %12s\n", "payload", "encoding", "pkt/s", "MiB/s", "bytes/pkt");
+  for (size_t payload_size : {16, 256, 4096}) {
+    auto pkts = make_packets(payload_size, rng);
+    for (bool compact : {false, true}) {
+      a0::File::remove(path);
+      auto opts = a0::File::Options::DEFAULT;
+      opts.create_options.size = 64 << 20;
+      opts.open_options.arena_mode = A0_ARENA_MODE_EXCLUSIVE;
+      a0::File file(path, opts);
+      a0::Writer writer(file);
+      a0::logger::CompactEncoder encoder;
+
+      uint64_t in_bytes = 0;
+      uint64_t out_bytes = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < num_pkts; i++) {
+        auto& pkt = pkts[i % pkts.size()];
+        auto out = compact ? encoder.encode(pkt) : pkt;
+        writer.write(out);
+
+        a0_packet_stats_t stats;
+        a0_packet_stats(*pkt.c, &stats);
+        in_bytes += stats.serial_size;
+        a0_packet_stats(*out.c, &stats);
+        out_bytes += stats.serial_size;
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      printf("%8zu %10s %12.0f %10.1f %12.1f\n",
+             payload_size,
+             compact ? "compact" : "a0",
+             num_pkts / elapsed.count(),
+             in_bytes / elapsed.count() / (1 << 20),
+             double(out_bytes) / num_pkts);
+    }
+  }
+  a0::File::remove(path);
+}
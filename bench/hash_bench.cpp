@@ -0,0 +1,49 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "a0/logger/hash.hpp"
+
+// Measures payload hash throughput, as used by the on_change policy.
+//
+// Usage: bin/bench_hash [iterations]
+
+template <typename Fn>
+static double gib_per_sec(const std::string& payload, int iters, Fn&& fn) {
+  uint64_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iters; i++) {
+    sink += fn(payload);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  // Keep the result alive so the loop isn't optimized out.
+  if (sink == 42) {
+    printf(" ");
+  }
+  return double(payload.size()) * iters / elapsed.count() / (1 << 30);
+}
+
+int main(int argc, char** argv) {
+  int iters = argc > 1 ? std::stoi(argv[1]) : 200;
+
+  std::mt19937_64 rng(0);
+  printf("%12s %16s %16s\n", "size", "hash64 GiB/s", "std::hash GiB/s");
+  for (size_t size : {64 << 10, 1 << 20, 4 << 20, 16 << 20}) {
+    std::string payload(size, 0);
+    for (auto& c : payload) {
+      c = char(rng());
+    }
+
+    auto ours = gib_per_sec(payload, iters, [](const std::string& p) {
+      return a0::logger::hash64(p);
+    });
+    auto std_hash = gib_per_sec(payload, iters, [](const std::string& p) {
+      return std::hash<std::string_view>{}(p);
+    });
+    printf("%12zu %16.2f %16.2f\n", size, ours, std_hash);
+  }
+}
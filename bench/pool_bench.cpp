@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "a0/logger/packet_pool.hpp"
+
+// Compares packet buffer allocation through a PacketPool against malloc.
+//
+// Each thread plays one FileLogger: it allocates a buffer per packet, keeps a
+// window of in-flight packets, and releases them in arrival order.
+//
+// Usage: bin/bench_pool [packets_per_thread]
+
+template <typename Acquire, typename Release>
+static double run(int threads, int pkts, size_t window, Acquire&& acquire, Release&& release) {
+  auto worker = [&](int id) {
+    std::mt19937_64 rng(id);
+    // Mostly small telemetry, some larger messages.
+    std::lognormal_distribution<double> sizes(std::log(512), 1.5);
+    std::deque<std::pair<void*, size_t>> inflight;
+    for (int i = 0; i < pkts; i++) {
+      size_t size = std::min<size_t>(8 << 20, 64 + size_t(sizes(rng)));
+      void* buf = acquire(id, size);
+      // Touch the buffer, as deserialization would.
+      memset(buf, 0, std::min<size_t>(size, 256));
+      inflight.push_back({buf, size});
+      if (inflight.size() > window) {
+        release(id, inflight.front().first, inflight.front().second);
+        inflight.pop_front();
+      }
+    }
+    for (auto [buf, size] : inflight) {
+      release(id, buf, size);
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> ts;
+  for (int i = 0; i < threads; i++) {
+    ts.emplace_back(worker, i);
+  }
+  for (auto&& t : ts) {
+    t.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return double(threads) * pkts / elapsed.count();
+}
+
+int main(int argc, char** argv) {
+  int pkts = argc > 1 ? std::stoi(argv[1]) : 2000000;
+  const size_t window = 64;
+
+  printf("%8s %16s %16s %10s %14s\n", "threads", "malloc pkt/s", "pool pkt/s", "hit rate", "footprint");
+  for (int threads : {1, 4, 16}) {
+    double malloc_rate = run(
+        threads, pkts, window,
+        [](int, size_t size) { return malloc(size); },
+        [](int, void* buf, size_t) { free(buf); });
+
+    auto budget = std::make_shared<a0::logger::PacketPool::Budget>(16 << 20);
+    std::vector<std::unique_ptr<a0::logger::PacketPool>> pools;
+    for (int i = 0; i < threads; i++) {
+      pools.push_back(std::make_unique<a0::logger::PacketPool>(budget));
+    }
+    uint64_t footprint = 0;
+    double pool_rate = run(
+        threads, pkts, window,
+        [&](int id, size_t size) { return pools[id]->acquire(size); },
+        [&](int id, void* buf, size_t size) { pools[id]->release(buf, size); });
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    for (auto&& pool : pools) {
+      auto stats = pool->stats();
+      hits += stats.hits;
+      misses += stats.misses;
+      footprint = std::max<uint64_t>(footprint, stats.cached_bytes + stats.outstanding_bytes);
+    }
+    printf("%8d %16.0f %16.0f %9.2f%% %12.1fKiB\n", threads, malloc_rate, pool_rate, 100.0 * hits / (hits + misses), footprint / 1024.0);
+  }
+}
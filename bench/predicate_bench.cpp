@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "a0/logger/predicate.hpp"
+
+// Measures predicate trigger throughput: payload parse plus evaluation.
+//
+// Usage: bin/bench_predicate [iterations]
+
+// A telemetry-like message, padded with extra fields to roughly size bytes.
+static std::string make_payload(size_t size, std::mt19937_64& rng) {
+  std::string payload = "{\"speed\": " + std::to_string(rng() % 40) +
+                        ", \"fault_code\": 0, \"state\": {\"mode\": \"auto\", \"gear\": \"drive\"}" +
+                        ", \"wheels\": [{\"rpm\": 2900}, {\"rpm\": 2950}]";
+  for (int i = 0; payload.size() < size; i++) {
+    payload += ", \"field_" + std::to_string(i) + "\": " + std::to_string(double(rng() % 100000) / 7);
+  }
+  return payload + "}";
+}
+
+int main(int argc, char** argv) {
+  int iters = argc > 1 ? std::stoi(argv[1]) : 200000;
+
+  std::vector<std::string> predicates = {
+      "speed > 20",
+      "fault_code != 0 || state.mode == \"estop\"",
+      "wheels[1].rpm >= 3000 && !(state.gear == \"park\") && speed < 35",
+  };
+
+  std::mt19937_64 rng(0);
+  printf("%8s  %-66s %12s %10s\n", "bytes", "predicate", "evals/s", "MiB/s");
+  for (size_t size : {128, 1024, 8192}) {
+    // Vary the payloads, so branch prediction doesn't see one message.
+    std::vector<std::string> payloads;
+    for (int i = 0; i < 64; i++) {
+      payloads.push_back(make_payload(size, rng));
+    }
+
+    for (auto&& src : predicates) {
+      a0::logger::Predicate predicate(src);
+      uint64_t matched = 0;
+      uint64_t bytes = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < iters; i++) {
+        auto& payload = payloads[i % payloads.size()];
+        matched += predicate.eval(payload).value_or(false);
+        bytes += payload.size();
+      }
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      // Keep the result alive so the loop isn't optimized out.
+      if (matched == uint64_t(-1)) {
+        printf(" ");
+      }
+      printf("%8zu  %-66s %12.0f %10.1f\n", payloads[0].size(), src.c_str(), iters / elapsed.count(), bytes / elapsed.count() / (1 << 20));
+    }
+  }
+}
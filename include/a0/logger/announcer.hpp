@@ -0,0 +1,82 @@
+#pragma once
+
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "a0/logger/mpmc_queue.hpp"
+
+namespace a0::logger {
+
+// Publishes announcements on a background thread.
+//
+// Callers push an Event, which builds its json when run. Every kFlushPeriod,
+// queued events are formatted and published in a batch, off the packet path.
+// If the queue is full, the event is dropped and counted.
+class Announcer {
+ public:
+  using Event = std::function<nlohmann::json()>;
+
+  static constexpr size_t kQueueSize = 4096;
+  static constexpr auto kFlushPeriod = std::chrono::milliseconds(10);
+
+ private:
+  Publisher pub;
+  MpmcQueue<Event> queue{kQueueSize};
+  std::atomic<uint64_t> num_dropped{0};
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool running{true};
+  std::thread t;
+
+  void flush() {
+    Event event;
+    while (queue.try_pop(&event)) {
+      pub.pub(event().dump());
+    }
+  }
+
+ public:
+  Announcer(std::string topic)
+      : pub(std::move(topic)) {
+    t = std::thread([this]() {
+      std::unique_lock<std::mutex> lk(mtx);
+      while (running) {
+        cv.wait_for(lk, kFlushPeriod);
+        lk.unlock();
+        flush();
+        lk.lock();
+      }
+    });
+  }
+
+  ~Announcer() {
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      running = false;
+      cv.notify_all();
+    }
+    t.join();
+    flush();
+  }
+
+  void push(Event event) {
+    if (!queue.try_push(std::move(event))) {
+      num_dropped++;
+    }
+  }
+
+  uint64_t dropped() const {
+    return num_dropped;
+  }
+};
+
+}  // namespace a0::logger
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "a0/logger/crc32c.hpp"
+
+namespace a0::logger {
+
+// A read-only mapping of a whole file.
+class MappedFile {
+  int fd{-1};
+  const uint8_t* ptr{nullptr};
+  uint64_t len{0};
+
+ public:
+  explicit MappedFile(const std::filesystem::path& path) {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error(path.string() + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      std::string err = std::strerror(errno);
+      close(fd);
+      throw std::runtime_error(path.string() + ": " + err);
+    }
+    len = st.st_size;
+    if (!len) {
+      return;
+    }
+    void* addr = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      std::string err = std::strerror(errno);
+      close(fd);
+      throw std::runtime_error(path.string() + ": " + err);
+    }
+    madvise(addr, len, MADV_SEQUENTIAL);
+    ptr = static_cast<const uint8_t*>(addr);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (ptr) {
+      munmap(const_cast<uint8_t*>(ptr), len);
+    }
+    close(fd);
+  }
+
+  const uint8_t* data() const {
+    return ptr;
+  }
+
+  uint64_t size() const {
+    return len;
+  }
+};
+
+// CRC32C of a closed logfile, per fixed size block, stored in a sidecar
+// <logfile>.crc.
+//
+// Sidecar layout, in host byte order:
+//   "A0CRC32C" | u32 version | u32 block_size | u64 file_size |
+//   u32 crc per block | u32 crc of all preceding bytes
+struct BlockChecksums {
+  static constexpr char kMagic[8] = {'A', '0', 'C', 'R', 'C', '3', '2', 'C'};
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kDefaultBlockSize = 1024 * 1024;
+  static constexpr const char* kSidecarSuffix = ".crc";
+
+  uint32_t block_size{kDefaultBlockSize};
+  uint64_t file_size{0};
+  std::vector<uint32_t> crcs;
+
+  // A byte range, [begin, end), that failed verification.
+  using Range = std::pair<uint64_t, uint64_t>;
+
+  static std::filesystem::path sidecar_path(const std::filesystem::path& logfile) {
+    return logfile.string() + kSidecarSuffix;
+  }
+
+  // Where save() writes before renaming into place.
+  static std::filesystem::path temp_path(const std::filesystem::path& sidecar) {
+    auto tmp = sidecar;
+    tmp.replace_filename("." + std::string(sidecar.filename()));
+    return tmp;
+  }
+
+  // Accumulates checksums over data fed in order, in pieces of any size.
+  class Builder;
+
+  // Checksums a file being written in place, through a mapping.
+  class InPlace;
+
+  static BlockChecksums compute(const uint8_t* data, uint64_t size, uint32_t block_size = kDefaultBlockSize) {
+    BlockChecksums bc;
+    bc.block_size = block_size;
+    bc.file_size = size;
+    for (uint64_t off = 0; off < size; off += block_size) {
+      bc.crcs.push_back(crc32c(data + off, std::min<uint64_t>(block_size, size - off)));
+    }
+    return bc;
+  }
+
+  static BlockChecksums compute(const std::filesystem::path& logfile) {
+    MappedFile file(logfile);
+    return compute(file.data(), file.size());
+  }
+
+  // Writes via a hidden temporary, so a partial sidecar is never seen.
+  void save(const std::filesystem::path& sidecar) const {
+    std::string out(kMagic, sizeof(kMagic));
+    append(out, kVersion);
+    append(out, block_size);
+    append(out, file_size);
+    for (uint32_t crc : crcs) {
+      append(out, crc);
+    }
+    append(out, crc32c(out.data(), out.size()));
+
+    auto tmp = temp_path(sidecar);
+    {
+      std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+      f.write(out.data(), out.size());
+      if (!f) {
+        throw std::runtime_error(tmp.string() + ": write failed");
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, sidecar, ec);
+    if (ec) {
+      std::filesystem::remove(tmp, ec);
+      throw std::runtime_error(sidecar.string() + ": " + ec.message());
+    }
+  }
+
+  // Throws std::runtime_error if the sidecar is missing or damaged.
+  static BlockChecksums load(const std::filesystem::path& sidecar) {
+    std::ifstream f(sidecar, std::ios::binary);
+    if (!f) {
+      throw std::runtime_error(sidecar.string() + ": cannot open");
+    }
+    std::string in{std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>()};
+
+    size_t pos = 0;
+    auto fail = [&](const char* what) {
+      throw std::runtime_error(sidecar.string() + ": " + what);
+    };
+    if (in.size() < sizeof(kMagic) || memcmp(in.data(), kMagic, sizeof(kMagic)) != 0) {
+      fail("not a checksum sidecar");
+    }
+    pos += sizeof(kMagic);
+
+    BlockChecksums bc;
+    uint32_t version = 0;
+    if (!take(in, pos, version) || !take(in, pos, bc.block_size) || !take(in, pos, bc.file_size)) {
+      fail("truncated header");
+    }
+    if (version != kVersion) {
+      fail("unsupported version");
+    }
+    if (!bc.block_size) {
+      fail("bad block size");
+    }
+    uint64_t num_blocks = (bc.file_size + bc.block_size - 1) / bc.block_size;
+    if (in.size() != pos + (num_blocks + 1) * sizeof(uint32_t)) {
+      fail("wrong size");
+    }
+    bc.crcs.resize(num_blocks);
+    for (auto& crc : bc.crcs) {
+      take(in, pos, crc);
+    }
+    uint32_t expected = crc32c(in.data(), pos);
+    uint32_t stored = 0;
+    take(in, pos, stored);
+    if (stored != expected) {
+      fail("checksum mismatch in sidecar");
+    }
+    return bc;
+  }
+
+  // Returns the ranges of data that don't match, merging adjacent blocks.
+  // Bytes missing from, or added to, the end of the file count as bad.
+  std::vector<Range> mismatches(const uint8_t* data, uint64_t size) const {
+    std::vector<Range> bad;
+    auto mark = [&](uint64_t begin, uint64_t end) {
+      if (!bad.empty() && bad.back().second == begin) {
+        bad.back().second = end;
+      } else {
+        bad.push_back({begin, end});
+      }
+    };
+    for (uint64_t i = 0; i < crcs.size(); i++) {
+      uint64_t begin = i * block_size;
+      uint64_t end = std::min<uint64_t>(begin + block_size, file_size);
+      if (end > size || crc32c(data + begin, end - begin) != crcs[i]) {
+        mark(begin, end);
+      }
+    }
+    if (size > file_size) {
+      mark(file_size, size);
+    }
+    return bad;
+  }
+
+ private:
+  template <typename T>
+  static void append(std::string& out, T val) {
+    out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+  }
+
+  template <typename T>
+  static bool take(const std::string& in, size_t& pos, T& val) {
+    if (pos + sizeof(val) > in.size()) {
+      return false;
+    }
+    memcpy(&val, in.data() + pos, sizeof(val));
+    pos += sizeof(val);
+    return true;
+  }
+};
+
+class BlockChecksums::Builder {
+  BlockChecksums bc;
+  uint32_t crc{0};
+  uint64_t in_block{0};
+
+ public:
+  explicit Builder(uint32_t block_size = kDefaultBlockSize) {
+    bc.block_size = block_size;
+  }
+
+  void update(const uint8_t* data, uint64_t len) {
+    while (len) {
+      uint64_t n = std::min<uint64_t>(len, bc.block_size - in_block);
+      crc = crc32c(data, n, crc);
+      in_block += n;
+      bc.file_size += n;
+      data += n;
+      len -= n;
+      if (in_block == bc.block_size) {
+        bc.crcs.push_back(crc);
+        crc = 0;
+        in_block = 0;
+      }
+    }
+  }
+
+  BlockChecksums finish() {
+    if (in_block) {
+      bc.crcs.push_back(crc);
+      crc = 0;
+      in_block = 0;
+    }
+    return bc;
+  }
+};
+
+// Blocks are checksummed as soon as they are final, while still in memory.
+// The first block, which holds headers that change on every write, is
+// checksummed last, along with the tail, in finish().
+class BlockChecksums::InPlace {
+  BlockChecksums bc;
+  // End of the blocks checksummed so far, after the first.
+  uint64_t done;
+
+ public:
+  explicit InPlace(uint32_t block_size = kDefaultBlockSize)
+      : done{block_size} {
+    bc.block_size = block_size;
+  }
+
+  // Bytes of data after the first block, and before stable_end, won't change.
+  void update(const uint8_t* data, uint64_t stable_end) {
+    while (done + bc.block_size <= stable_end) {
+      bc.crcs.push_back(crc32c(data + done, bc.block_size));
+      done += bc.block_size;
+    }
+  }
+
+  // data holds the final file, size bytes, which is at least the stable_end
+  // of every update.
+  BlockChecksums finish(const uint8_t* data, uint64_t size) {
+    BlockChecksums out;
+    out.block_size = bc.block_size;
+    out.file_size = size;
+    if (size) {
+      out.crcs.push_back(crc32c(data, std::min<uint64_t>(bc.block_size, size)));
+    }
+    out.crcs.insert(out.crcs.end(), bc.crcs.begin(), bc.crcs.end());
+    for (uint64_t off = done; off < size; off += bc.block_size) {
+      out.crcs.push_back(crc32c(data + off, std::min<uint64_t>(bc.block_size, size - off)));
+    }
+    return out;
+  }
+};
+
+}  // namespace a0::logger
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <a0.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace a0::logger {
+
+// Compact logfile encoding.
+//
+// Packets are saved with a single "a0_enc" header. The original headers are
+// packed in front of the payload:
+//
+//   varint num_headers
+//   per header:
+//     varint key_ref   0 introduces a new key: varint len + bytes.
+//                      Otherwise, the key is keys[key_ref - 1].
+//     u8     type      Selects the value layout below.
+//     value
+//   original payload
+//
+// Keys are interned per logfile, so a decoder must read the file from the
+// start. Values that round-trip exactly are stored as fixed-width binary:
+//
+//   TEXT:    varint len + bytes
+//   DECIMAL: u8 width + u64 value           ex. a0_time_mono, a0_transport_seq
+//   WALL:    i64 sec + u32 nsec             ex. a0_time_wall
+//   UUID:    16 bytes                       ex. a0_writer_id
+//
+// The packet id is preserved.
+namespace compact_detail {
+
+static constexpr std::string_view kEncKey = "a0_enc";
+static constexpr std::string_view kEncVal = "compact1";
+
+enum Type : uint8_t {
+  TEXT = 0,
+  DECIMAL = 1,
+  WALL = 2,
+  UUID = 3,
+};
+
+static inline void put_varint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(char(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(char(v));
+}
+
+template <typename T>
+static inline void put_fixed(std::string& out, T v) {
+  out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static inline void put_text(std::string& out, std::string_view s) {
+  put_varint(out, s.size());
+  out.append(s);
+}
+
+struct Cursor {
+  std::string_view in;
+
+  void need(size_t n) {
+    if (in.size() < n) {
+      throw std::runtime_error("Compact decode failed. Truncated packet");
+    }
+  }
+
+  uint64_t varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      need(1);
+      uint8_t b = in[0];
+      in.remove_prefix(1);
+      v |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        return v;
+      }
+    }
+    throw std::runtime_error("Compact decode failed. Bad varint");
+  }
+
+  template <typename T>
+  T fixed() {
+    need(sizeof(T));
+    T v;
+    memcpy(&v, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return v;
+  }
+
+  std::string_view bytes(size_t n) {
+    need(n);
+    auto out = in.substr(0, n);
+    in.remove_prefix(n);
+    return out;
+  }
+
+  std::string_view text() {
+    return bytes(varint());
+  }
+};
+
+static inline std::string format_decimal(uint64_t v, uint8_t width) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%0*llu", int(width), (unsigned long long)v);
+  return buf;
+}
+
+// Any digit string round-trips: leading zeros are kept by the stored width.
+static inline bool parse_decimal(std::string_view s, uint64_t* v) {
+  // 19 digits always fit in a u64.
+  if (s.empty() || s.size() > 19) {
+    return false;
+  }
+  uint64_t r = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    r = r * 10 + (c - '0');
+  }
+  *v = r;
+  return true;
+}
+
+static inline std::string format_wall(int64_t sec, uint32_t nsec) {
+  time_t t = sec;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%09u-00:00",
+           tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+           tm.tm_hour, tm.tm_min, tm.tm_sec, nsec);
+  return buf;
+}
+
+// Days from 1970-01-01 to the given proleptic Gregorian date.
+static inline int64_t days_from_civil(int64_t y, uint32_t m, uint32_t d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  uint32_t yoe = uint32_t(y - era * 400);
+  uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + int64_t(doe) - 719468;
+}
+
+static inline uint32_t days_in_month(uint32_t y, uint32_t m) {
+  static constexpr uint8_t kDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+  return m == 2 && leap ? 29 : kDays[m - 1];
+}
+
+// Expects the a0 wall time format: 2006-01-02T15:04:05.999999999-00:00
+// Fields are range checked, rather than normalized, so anything accepted
+// formats back to the same text.
+static inline bool parse_wall(std::string_view s, int64_t* sec, uint32_t* nsec) {
+  static constexpr std::string_view kLayout = "dddd-dd-ddTdd:dd:dd.ddddddddd-00:00";
+  if (s.size() != kLayout.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < s.size(); i++) {
+    if (kLayout[i] == 'd' ? (s[i] < '0' || s[i] > '9') : s[i] != kLayout[i]) {
+      return false;
+    }
+  }
+  auto num = [&](size_t off, size_t len) {
+    uint32_t v = 0;
+    for (size_t i = off; i < off + len; i++) {
+      v = v * 10 + (s[i] - '0');
+    }
+    return v;
+  };
+  uint32_t year = num(0, 4);
+  uint32_t mon = num(5, 2);
+  uint32_t day = num(8, 2);
+  uint32_t hour = num(11, 2);
+  uint32_t min = num(14, 2);
+  uint32_t secs = num(17, 2);
+  if (mon < 1 || mon > 12 || day < 1 || day > days_in_month(year, mon) || hour > 23 || min > 59 || secs > 59) {
+    return false;
+  }
+  *sec = days_from_civil(year, mon, day) * 86400 + hour * 3600 + min * 60 + secs;
+  *nsec = num(20, 9);
+  return true;
+}
+
+static inline int hex_val(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+static inline bool is_uuid_dash(size_t i) {
+  return i == 8 || i == 13 || i == 18 || i == 23;
+}
+
+static inline std::string format_uuid(std::string_view bin) {
+  static const char* kHex = "0123456789abcdef";
+  std::string out;
+  for (size_t i = 0; i < 16; i++) {
+    if (out.size() == 8 || out.size() == 13 || out.size() == 18 || out.size() == 23) {
+      out.push_back('-');
+    }
+    out.push_back(kHex[uint8_t(bin[i]) >> 4]);
+    out.push_back(kHex[uint8_t(bin[i]) & 0xf]);
+  }
+  return out;
+}
+
+// Writes 16 bytes to bin.
+static inline bool parse_uuid(std::string_view s, char* bin) {
+  if (s.size() != 36) {
+    return false;
+  }
+  for (size_t i = 0; i < 36; i++) {
+    if (is_uuid_dash(i)) {
+      if (s[i] != '-') {
+        return false;
+      }
+      continue;
+    }
+    int hi = hex_val(s[i]);
+    int lo = hex_val(s[++i]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    *bin++ = char(hi << 4 | lo);
+  }
+  return true;
+}
+
+static inline Packet with_id(Packet pkt, std::string_view id) {
+  memcpy(pkt.c->id, id.data(), std::min(id.size(), sizeof(pkt.c->id) - 1));
+  return pkt;
+}
+
+}  // namespace compact_detail
+
+class CompactEncoder {
+  std::unordered_map<std::string, uint64_t> key_ids;
+
+ public:
+  // Must be called when starting a new logfile.
+  void reset() {
+    key_ids.clear();
+  }
+
+  Packet encode(Packet pkt) {
+    using namespace compact_detail;
+
+    std::string out;
+    out.reserve(64 + pkt.payload().size());
+    put_varint(out, pkt.headers().size());
+    for (auto&& [key, val] : pkt.headers()) {
+      auto it = key_ids.find(key);
+      if (it == key_ids.end()) {
+        put_varint(out, 0);
+        put_text(out, key);
+        key_ids.emplace(key, key_ids.size() + 1);
+      } else {
+        put_varint(out, it->second);
+      }
+
+      uint64_t dec;
+      int64_t sec;
+      uint32_t nsec;
+      char uuid[16];
+      if (parse_decimal(val, &dec)) {
+        out.push_back(DECIMAL);
+        out.push_back(char(val.size()));
+        put_fixed(out, dec);
+      } else if (parse_wall(val, &sec, &nsec)) {
+        out.push_back(WALL);
+        put_fixed(out, sec);
+        put_fixed(out, nsec);
+      } else if (parse_uuid(val, uuid)) {
+        out.push_back(UUID);
+        out.append(uuid, sizeof(uuid));
+      } else {
+        out.push_back(TEXT);
+        put_text(out, val);
+      }
+    }
+    out.append(pkt.payload());
+
+    return with_id(Packet({{std::string(kEncKey), std::string(kEncVal)}}, std::move(out)), pkt.id());
+  }
+};
+
+class CompactDecoder {
+  std::vector<std::string> keys;
+
+ public:
+  // Must be called when starting a new logfile.
+  void reset() {
+    keys.clear();
+  }
+
+  // Packets not in the compact encoding are returned as-is.
+  Packet decode(Packet pkt) {
+    using namespace compact_detail;
+
+    auto enc = pkt.headers().find(std::string(kEncKey));
+    if (enc == pkt.headers().end() || enc->second != kEncVal) {
+      return pkt;
+    }
+
+    Cursor cur{pkt.payload()};
+    std::unordered_multimap<std::string, std::string> headers;
+    auto num_headers = cur.varint();
+    for (uint64_t i = 0; i < num_headers; i++) {
+      auto key_ref = cur.varint();
+      if (key_ref == 0) {
+        keys.emplace_back(cur.text());
+        key_ref = keys.size();
+      }
+      if (key_ref > keys.size()) {
+        throw std::runtime_error("Compact decode failed. Unknown key. Was the file read from the start?");
+      }
+      const auto& key = keys[key_ref - 1];
+
+      switch (cur.fixed<uint8_t>()) {
+        case DECIMAL: {
+          auto width = cur.fixed<uint8_t>();
+          headers.emplace(key, format_decimal(cur.fixed<uint64_t>(), width));
+          break;
+        }
+        case WALL: {
+          auto sec = cur.fixed<int64_t>();
+          headers.emplace(key, format_wall(sec, cur.fixed<uint32_t>()));
+          break;
+        }
+        case UUID: {
+          headers.emplace(key, format_uuid(cur.bytes(16)));
+          break;
+        }
+        case TEXT: {
+          headers.emplace(key, std::string(cur.text()));
+          break;
+        }
+        default: {
+          throw std::runtime_error("Compact decode failed. Unknown value type");
+        }
+      }
+    }
+
+    return with_id(Packet(std::move(headers), std::string(cur.in)), pkt.id());
+  }
+};
+
+// Reads a logfile, undoing the compact encoding if needed.
+class CompactReaderSync {
+  ReaderSync reader;
+  CompactDecoder decoder;
+
+ public:
+  CompactReaderSync(File file)
+      : reader(file, INIT_OLDEST) {}
+
+  bool can_read() {
+    return reader.can_read();
+  }
+
+  Packet read() {
+    return decoder.decode(reader.read());
+  }
+};
+
+}  // namespace a0::logger
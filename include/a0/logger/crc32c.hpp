@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+
+namespace a0::logger {
+
+// CRC32C (Castagnoli), as used by iSCSI, ext4, and SSE4.2's crc32.
+//
+// Uses the crc32 instructions on x86-64 with SSE4.2 and on ARMv8 with the
+// CRC extension, checked at runtime. Otherwise falls back to slicing-by-8
+// tables, at roughly a tenth of the speed.
+namespace crc32c_detail {
+
+static constexpr uint32_t kPoly = 0x82F63B78;  // Reflected.
+
+struct Tables {
+  uint32_t t[8][256];
+
+  Tables() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; j++) {
+        crc = (crc >> 1) ^ (kPoly & (0 - (crc & 1)));
+      }
+      t[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+      for (int k = 1; k < 8; k++) {
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+      }
+    }
+  }
+};
+
+static inline uint32_t extend_sw(uint32_t crc, const uint8_t* p, size_t len) {
+  static const Tables tables;
+  const auto& t = tables.t;
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    v ^= crc;
+    crc = t[7][v & 0xFF] ^ t[6][(v >> 8) & 0xFF] ^ t[5][(v >> 16) & 0xFF] ^ t[4][(v >> 24) & 0xFF] ^
+          t[3][(v >> 32) & 0xFF] ^ t[2][(v >> 40) & 0xFF] ^ t[1][(v >> 48) & 0xFF] ^ t[0][v >> 56];
+    p += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2"))) static inline uint32_t extend_hw(uint32_t crc, const uint8_t* p, size_t len) {
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+    p += 8;
+    len -= 8;
+  }
+  crc = uint32_t(crc64);
+  while (len--) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+
+static inline bool has_hw() {
+  static const bool has = __builtin_cpu_supports("sse4.2");
+  return has;
+}
+
+#elif defined(__aarch64__)
+
+__attribute__((target("+crc"))) static inline uint32_t extend_hw(uint32_t crc, const uint8_t* p, size_t len) {
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc = __crc32cd(crc, v);
+    p += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = __crc32cb(crc, *p++);
+  }
+  return crc;
+}
+
+static inline bool has_hw() {
+  static const bool has = getauxval(AT_HWCAP) & HWCAP_CRC32;
+  return has;
+}
+
+#else
+
+static inline uint32_t extend_hw(uint32_t crc, const uint8_t* p, size_t len) {
+  return extend_sw(crc, p, len);
+}
+
+static inline bool has_hw() {
+  return false;
+}
+
+#endif
+
+}  // namespace crc32c_detail
+
+// Continues a CRC32C over more data. Start with crc = 0.
+static inline uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0) {
+  using namespace crc32c_detail;
+  auto* p = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  crc = has_hw() ? extend_hw(crc, p, len) : extend_sw(crc, p, len);
+  return ~crc;
+}
+
+}  // namespace a0::logger
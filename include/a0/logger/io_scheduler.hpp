@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace a0::logger {
+
+// Shares a global write budget, in bytes per second, among clients in
+// proportion to their weights.
+//
+// Each client has a token bucket. Every kTick, the budget for the tick is
+// divided among clients that want tokens, by weight. Shares a client doesn't
+// need go to the others. A client that isn't backlogged may hold up to its
+// share of kBurst worth of budget, so small writes go out immediately.
+//
+// Clients spend tokens on their own threads, without locking. Backlogged
+// clients are told when tokens arrive.
+class IoScheduler {
+ public:
+  static constexpr auto kTick = std::chrono::milliseconds(10);
+  static constexpr auto kBurst = std::chrono::milliseconds(100);
+
+  class Client {
+    friend class IoScheduler;
+
+    const double weight;
+    const std::function<void()> onrefill;
+    std::atomic<int64_t> tokens{0};
+    std::atomic<int64_t> pending{0};
+    std::atomic<bool> removed{false};
+
+   public:
+    Client(double weight_, std::function<void()> onrefill_)
+        : weight{weight_}, onrefill{std::move(onrefill_)} {}
+
+    // Spends tokens if there are enough.
+    bool try_consume(int64_t bytes) {
+      int64_t have = tokens;
+      while (have >= bytes) {
+        if (tokens.compare_exchange_weak(have, have - bytes)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Spends tokens regardless, going into debt if needed.
+    void force_consume(int64_t bytes) {
+      tokens -= bytes;
+    }
+
+    // Bytes waiting on tokens. Counts towards the client's demand.
+    void add_pending(int64_t bytes) {
+      pending += bytes;
+    }
+
+    int64_t pending_bytes() const {
+      return pending;
+    }
+  };
+
+ private:
+  const double bytes_per_sec;
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<std::shared_ptr<Client>> clients;
+  // True while onrefill callbacks run, outside mtx. remove() waits on it.
+  bool notifying{false};
+  std::condition_variable notified_cv;
+  bool running{true};
+  std::thread t;
+
+  void refill(double available) {
+    double total_weight = 0;
+    for (auto&& c : clients) {
+      total_weight += c->weight;
+    }
+    const double burst = bytes_per_sec * std::chrono::duration<double>(kBurst).count();
+
+    struct Want {
+      Client* client;
+      double demand;
+    };
+    std::vector<Want> wants;
+    for (auto&& c : clients) {
+      double cap = burst * c->weight / total_weight;
+      double demand = c->pending + cap - c->tokens;
+      if (demand > 0) {
+        wants.push_back({c.get(), demand});
+      }
+    }
+
+    // Water-fill: split by weight, cap at demand, repeat with the leftovers.
+    while (available >= 1 && !wants.empty()) {
+      double want_weight = 0;
+      for (auto&& w : wants) {
+        want_weight += w.client->weight;
+      }
+      double spent = 0;
+      std::vector<Want> still;
+      for (auto&& w : wants) {
+        double give = std::min(w.demand, available * w.client->weight / want_weight);
+        w.client->tokens += int64_t(give);
+        spent += give;
+        if (w.demand - give >= 1) {
+          still.push_back({w.client, w.demand - give});
+        }
+      }
+      available -= spent;
+      wants = std::move(still);
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lk(mtx);
+    auto last = std::chrono::steady_clock::now();
+    while (running) {
+      cv.wait_for(lk, kTick);
+      if (!running) {
+        break;
+      }
+      auto now = std::chrono::steady_clock::now();
+      std::chrono::duration<double> dt = now - last;
+      last = now;
+      if (clients.empty()) {
+        continue;
+      }
+
+      refill(bytes_per_sec * dt.count());
+
+      // Callbacks run outside mtx, so a slow flush doesn't block add().
+      // remove() waits for them instead.
+      std::vector<std::shared_ptr<Client>> ready;
+      for (auto&& c : clients) {
+        if (c->pending > 0) {
+          ready.push_back(c);
+        }
+      }
+      if (ready.empty()) {
+        continue;
+      }
+      notifying = true;
+      lk.unlock();
+      for (auto&& c : ready) {
+        if (!c->removed) {
+          c->onrefill();
+        }
+      }
+      lk.lock();
+      notifying = false;
+      notified_cv.notify_all();
+    }
+  }
+
+ public:
+  explicit IoScheduler(uint64_t bytes_per_sec_)
+      : bytes_per_sec{double(bytes_per_sec_)} {
+    t = std::thread([this]() { run(); });
+  }
+
+  ~IoScheduler() {
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      running = false;
+      cv.notify_all();
+    }
+    t.join();
+  }
+
+  // onrefill is called on the scheduler thread while the client has pending
+  // bytes, after tokens are added.
+  std::shared_ptr<Client> add(double weight, std::function<void()> onrefill) {
+    auto client = std::make_shared<Client>(weight, std::move(onrefill));
+    std::unique_lock<std::mutex> lk(mtx);
+    clients.push_back(client);
+    return client;
+  }
+
+  // Once this returns, the client's onrefill is not running, and won't be
+  // called again. Must not be called holding a lock that onrefill takes, nor
+  // from within onrefill.
+  void remove(const std::shared_ptr<Client>& client) {
+    std::unique_lock<std::mutex> lk(mtx);
+    client->removed = true;
+    clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+    notified_cv.wait(lk, [&]() { return !notifying; });
+  }
+};
+
+}  // namespace a0::logger
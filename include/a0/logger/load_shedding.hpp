@@ -0,0 +1,85 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <optional>
+#include <vector>
+
+#include "a0/logger/unit_parse.hpp"
+
+namespace a0::logger {
+
+// Decides which rules to pause when readers fall behind.
+//
+// If a rule has lagged more than max_lag packets for the sustain duration, all
+// rules with a lower priority are shed. Once no active rule has lagged for the
+// sustain duration, shedding stops.
+class LoadShedder {
+ public:
+  struct Config {
+    uint64_t max_lag;
+    std::chrono::nanoseconds sustain;
+  };
+
+  struct Sample {
+    int priority;
+    uint64_t lag;
+    bool shedding;
+  };
+
+ private:
+  Config config;
+  std::optional<int> shed_below;
+  std::optional<std::chrono::steady_clock::time_point> lag_since;
+  std::optional<std::chrono::steady_clock::time_point> clear_since;
+
+ public:
+  LoadShedder(Config config_)
+      : config{config_} {}
+
+  // Returns the priority below which rules should be shed, if any.
+  std::optional<int> update(const std::vector<Sample>& samples,
+                            std::chrono::steady_clock::time_point now) {
+    std::optional<int> worst;
+    for (auto&& s : samples) {
+      if (!s.shedding && s.lag > config.max_lag) {
+        worst = worst ? std::max(*worst, s.priority) : s.priority;
+      }
+    }
+
+    if (worst) {
+      clear_since = std::nullopt;
+      if (!lag_since) {
+        lag_since = now;
+      }
+      if (now - *lag_since >= config.sustain) {
+        shed_below = shed_below ? std::max(*shed_below, *worst) : *worst;
+        lag_since = std::nullopt;
+      }
+    } else {
+      lag_since = std::nullopt;
+      if (shed_below) {
+        if (!clear_since) {
+          clear_since = now;
+        }
+        if (now - *clear_since >= config.sustain) {
+          shed_below = std::nullopt;
+          clear_since = std::nullopt;
+        }
+      }
+    }
+
+    return shed_below;
+  }
+};
+
+static inline void from_json(const nlohmann::json& j, LoadShedder::Config& c) {
+  j.at("max_lag").get_to(c.max_lag);
+  c.sustain = std::chrono::seconds(2);
+  if (j.count("sustain")) {
+    c.sustain = parse_duration(j.at("sustain"));
+  }
+}
+
+}  // namespace a0::logger
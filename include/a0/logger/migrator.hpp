@@ -0,0 +1,370 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "a0/logger/block_checksums.hpp"
+
+namespace a0::logger {
+
+// Moves completed logfiles from a fast staging directory (ex. /dev/shm) into
+// the savepath. Files are copied sequentially, with large aligned blocks, on a
+// background thread, optionally bounded by a bandwidth limit.
+//
+// A failed copy is retried, with a backoff, so an outage of the savepath
+// doesn't leave files in staging until the next run.
+class Migrator {
+ public:
+  // Called after each file is handled. error is empty on success.
+  using OnDone = std::function<void(const std::filesystem::path& dst, const std::string& error)>;
+  // Trims a logfile left in progress by a crash down to the space it used.
+  using Trim = std::function<void(const std::filesystem::path& logfile)>;
+
+  static constexpr size_t kBlockSize = 4 * 1024 * 1024;
+  static constexpr size_t kBlockAlign = 4096;
+  static constexpr auto kRetryMin = std::chrono::seconds(1);
+  static constexpr auto kRetryMax = std::chrono::seconds(60);
+
+  struct Stats {
+    // Files waiting to be copied, including retries.
+    size_t queued;
+    // Files whose last copy failed.
+    size_t retrying;
+  };
+
+ private:
+  const std::filesystem::path staging_root;
+  const std::filesystem::path save_root;
+  const uint64_t bytes_per_sec;
+  const OnDone ondone;
+  const Trim trim;
+
+  struct Pending {
+    std::filesystem::path staged;
+    uint32_t failures{0};
+    std::chrono::steady_clock::time_point not_before{};
+  };
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<Pending> queue;
+  bool running{true};
+  std::thread t;
+
+  // Past the shutdown deadline, unfinished work is left for the next run.
+  std::atomic<std::chrono::steady_clock::time_point> deadline{
+      std::chrono::steady_clock::time_point::max()};
+
+  bool past_deadline() const {
+    return std::chrono::steady_clock::now() > deadline.load();
+  }
+
+ public:
+  Migrator(std::filesystem::path staging_root_,
+           std::filesystem::path save_root_,
+           uint64_t bytes_per_sec_,
+           OnDone ondone_,
+           Trim trim_ = {})
+      : staging_root{std::move(staging_root_)},
+        save_root{std::move(save_root_)},
+        bytes_per_sec{bytes_per_sec_},
+        ondone{std::move(ondone_)},
+        trim{std::move(trim_)} {
+    recover();
+    t = std::thread([this]() { run(); });
+  }
+
+  // Finishes queued files, until the deadline.
+  // Files left in the staging area are recovered on restart.
+  void shutdown(std::chrono::steady_clock::time_point deadline_) {
+    deadline = deadline_;
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      running = false;
+      cv.notify_all();
+    }
+    if (t.joinable()) {
+      t.join();
+    }
+  }
+
+  ~Migrator() {
+    shutdown(deadline);
+  }
+
+  // Queue a completed file, located under staging_root, for migration.
+  void enqueue(std::filesystem::path staged) {
+    std::unique_lock<std::mutex> lk(mtx);
+    queue.push_back({std::move(staged)});
+    cv.notify_all();
+  }
+
+  Stats stats() {
+    std::unique_lock<std::mutex> lk(mtx);
+    Stats s{queue.size(), 0};
+    for (auto&& p : queue) {
+      s.retrying += p.failures > 0;
+    }
+    return s;
+  }
+
+ private:
+  // Records the temporaries of the copy in progress, so a crash doesn't
+  // leave them in the save_root. Empty once the copy is resolved.
+  std::filesystem::path journal_path() const {
+    return save_root / ".migrating";
+  }
+
+  void clear_journal() {
+    std::ofstream(journal_path(), std::ios::trunc);
+  }
+
+  // Once nothing is left to copy, the journal isn't left in the save_root.
+  void remove_journal() {
+    std::error_code ec;
+    std::filesystem::remove(journal_path(), ec);
+  }
+
+  // Queue files left behind by a previous run. Must run before any logfile
+  // is opened in the staging_root.
+  //
+  // Logfiles still in progress (dot-prefixed) were cut off by a crash. They
+  // are trimmed, given their complete name, and migrated like the rest.
+  void recover() {
+    std::error_code ec;
+    std::ifstream journal(journal_path());
+    std::string tmp;
+    while (std::getline(journal, tmp)) {
+      if (!tmp.empty()) {
+        std::filesystem::remove(tmp, ec);
+      }
+    }
+    std::filesystem::remove(journal_path(), ec);
+
+    std::vector<std::filesystem::path> found;
+    std::filesystem::recursive_directory_iterator it(staging_root, ec);
+    if (ec) {
+      return;
+    }
+    for (; it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+      if (it->is_regular_file(ec)) {
+        found.push_back(it->path());
+      }
+    }
+
+    for (auto&& path : found) {
+      std::string filename = path.filename();
+      if (filename.rfind(".", 0) != 0) {
+        queue.push_back({path});
+        continue;
+      }
+      if (path.extension() != ".a0") {
+        continue;
+      }
+      if (trim) {
+        try {
+          trim(path);
+        } catch (const std::exception&) {
+          // Migrated untrimmed. Still readable.
+        }
+      }
+      auto complete = path;
+      complete.replace_filename(filename.substr(1));
+      std::filesystem::rename(path, complete, ec);
+      if (!ec) {
+        queue.push_back({complete});
+      }
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+      cv.wait(lk, [&]() { return !queue.empty() || !running; });
+      if (queue.empty() || past_deadline()) {
+        return;
+      }
+
+      // Takes the first file that isn't backing off.
+      auto now = std::chrono::steady_clock::now();
+      auto it = std::find_if(queue.begin(), queue.end(), [&](const Pending& p) { return p.not_before <= now; });
+      if (it == queue.end()) {
+        if (!running) {
+          // Retries are left for the next run.
+          return;
+        }
+        auto next = std::min_element(queue.begin(), queue.end(), [](const Pending& a, const Pending& b) {
+          return a.not_before < b.not_before;
+        });
+        cv.wait_until(lk, next->not_before);
+        continue;
+      }
+      auto pending = std::move(*it);
+      queue.erase(it);
+
+      lk.unlock();
+      bool retry = !migrate(pending);
+      lk.lock();
+
+      if (retry && running) {
+        pending.failures++;
+        pending.not_before = std::chrono::steady_clock::now() + backoff(pending.failures);
+        queue.push_back(std::move(pending));
+      }
+      if (queue.empty()) {
+        remove_journal();
+      }
+    }
+  }
+
+  static std::chrono::steady_clock::duration backoff(uint32_t failures) {
+    auto delay = kRetryMin * (uint64_t(1) << std::min<uint32_t>(failures - 1, 16));
+    return std::min<std::chrono::steady_clock::duration>(delay, kRetryMax);
+  }
+
+  // Returns false if the copy failed and should be retried.
+  bool migrate(const Pending& pending) {
+    auto dst = save_root / std::filesystem::relative(pending.staged, staging_root);
+    std::string err = copy_file(pending.staged, dst);
+    std::error_code ec;
+    bool retry = !err.empty() && !past_deadline() && std::filesystem::exists(pending.staged, ec);
+    if (retry) {
+      auto delay = std::chrono::duration_cast<std::chrono::seconds>(backoff(pending.failures + 1));
+      err += ". Retrying in " + std::to_string(delay.count()) + "s";
+    }
+    ondone(dst, err);
+    return !retry;
+  }
+
+  // Copy src to dst via a hidden temporary, then remove src.
+  // The checksum sidecar for dst is computed from the blocks as they are
+  // copied, and saved just before dst appears.
+  // Returns an error message on failure.
+  std::string copy_file(const std::filesystem::path& src, const std::filesystem::path& dst) {
+    std::error_code ec;
+    std::filesystem::create_directories(dst.parent_path(), ec);
+    if (ec) {
+      return ec.message();
+    }
+
+    auto tmp = dst;
+    tmp.replace_filename("." + std::string(dst.filename()) + ".migrating");
+    auto sidecar = BlockChecksums::sidecar_path(dst);
+    {
+      std::ofstream journal(journal_path(), std::ios::trunc);
+      journal << tmp.string() << "\n"
+              << BlockChecksums::temp_path(sidecar).string() << "\n";
+    }
+
+    int src_fd = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+      return std::strerror(errno);
+    }
+    struct stat src_stat;
+    fstat(src_fd, &src_stat);
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int dst_fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dst_fd < 0) {
+      std::string err = std::strerror(errno);
+      close(src_fd);
+      return err;
+    }
+
+    std::unique_ptr<char, decltype(&free)> block{
+        static_cast<char*>(aligned_alloc(kBlockAlign, kBlockSize)), &free};
+
+    BlockChecksums::Builder checksums;
+    std::string err;
+    uint64_t copied = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (err.empty()) {
+      if (past_deadline()) {
+        err = "Interrupted by shutdown. Will resume on restart";
+        break;
+      }
+      ssize_t n = read(src_fd, block.get(), kBlockSize);
+      if (n < 0) {
+        err = std::strerror(errno);
+        break;
+      }
+      if (n == 0) {
+        break;
+      }
+      for (ssize_t off = 0; off < n;) {
+        ssize_t w = write(dst_fd, block.get() + off, n - off);
+        if (w < 0) {
+          err = std::strerror(errno);
+          break;
+        }
+        off += w;
+      }
+      checksums.update(reinterpret_cast<const uint8_t*>(block.get()), n);
+      copied += n;
+
+      if (bytes_per_sec) {
+        std::this_thread::sleep_until(std::min(
+            start + std::chrono::nanoseconds(uint64_t(1e9 * copied / bytes_per_sec)),
+            deadline.load()));
+      }
+    }
+
+    if (err.empty() && fdatasync(dst_fd) != 0) {
+      err = std::strerror(errno);
+    }
+    // The data is on disk. Don't let it evict the page cache.
+    posix_fadvise(dst_fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(dst_fd);
+    close(src_fd);
+
+    if (err.empty()) {
+      try {
+        checksums.finish().save(sidecar);
+      } catch (const std::exception& e) {
+        err = e.what();
+      }
+    }
+    if (err.empty()) {
+      std::filesystem::rename(tmp, dst, ec);
+      if (ec) {
+        err = ec.message();
+        std::filesystem::remove(sidecar, ec);
+      }
+    }
+    if (!err.empty()) {
+      std::filesystem::remove(tmp, ec);
+      clear_journal();
+      return err;
+    }
+    clear_journal();
+
+    // A restarted logger may have replaced the staged file while we were
+    // copying. If so, the replacement is already queued. Leave it be.
+    struct stat now_stat;
+    if (stat(src.c_str(), &now_stat) == 0 && now_stat.st_ino == src_stat.st_ino) {
+      std::filesystem::remove(src, ec);
+    }
+    return "";
+  }
+};
+
+}  // namespace a0::logger
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace a0::logger {
+
+// Bounded lock-free multi-producer multi-consumer queue.
+// Based on Dmitry Vyukov's bounded MPMC queue.
+template <typename T>
+class MpmcQueue {
+  struct Cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  const size_t mask;
+  std::unique_ptr<Cell[]> cells;
+  alignas(64) std::atomic<size_t> enqueue_pos{0};
+  alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+  static size_t round_up_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+      p <<= 1;
+    }
+    return p;
+  }
+
+ public:
+  explicit MpmcQueue(size_t capacity)
+      : mask{round_up_pow2(capacity) - 1}, cells{new Cell[mask + 1]} {
+    for (size_t i = 0; i <= mask; i++) {
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns false if the queue is full.
+  bool try_push(T&& val) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells[pos & mask];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.data = std::move(val);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Returns false if the queue is empty.
+  bool try_pop(T* out) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells[pos & mask];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          *out = std::move(cell.data);
+          cell.data = T{};
+          cell.seq.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+}  // namespace a0::logger
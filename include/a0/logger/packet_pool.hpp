@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace a0::logger {
+
+// Recycles packet buffers, in power-of-two size classes.
+//
+// Buffers are acquired on a reader thread, and usually released on the same
+// one, once the packet leaves the FileLogger's buffer. Released buffers are
+// kept for reuse within a Budget shared by all pools. Beyond that, or above
+// kMaxClass, they go back to malloc.
+class PacketPool {
+ public:
+  // Bytes that all pools sharing it may keep cached, in total.
+  class Budget {
+    const uint64_t max_bytes;
+    std::atomic<uint64_t> used_bytes{0};
+
+   public:
+    explicit Budget(uint64_t max_bytes_)
+        : max_bytes{max_bytes_} {}
+
+    bool take(uint64_t bytes) {
+      uint64_t used = used_bytes.load(std::memory_order_relaxed);
+      do {
+        if (used + bytes > max_bytes) {
+          return false;
+        }
+      } while (!used_bytes.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+      return true;
+    }
+
+    void give(uint64_t bytes) {
+      used_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    uint64_t used() const {
+      return used_bytes.load(std::memory_order_relaxed);
+    }
+  };
+
+  static constexpr size_t kMinClassLog2 = 8;   // 256B
+  static constexpr size_t kMaxClassLog2 = 22;  // 4MiB
+  static constexpr size_t kMaxClass = size_t(1) << kMaxClassLog2;
+  static constexpr size_t kNumClasses = kMaxClassLog2 - kMinClassLog2 + 1;
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    // Bytes held in free lists, awaiting reuse.
+    uint64_t cached_bytes;
+    // Bytes handed out and not yet released.
+    uint64_t outstanding_bytes;
+  };
+
+ private:
+  const std::shared_ptr<Budget> budget;
+
+  mutable std::mutex mtx;
+  std::vector<void*> free_lists[kNumClasses];
+  Stats counters{};
+
+  static size_t class_of(size_t size) {
+    size_t log2 = kMinClassLog2;
+    while ((size_t(1) << log2) < size) {
+      log2++;
+    }
+    return log2 - kMinClassLog2;
+  }
+
+  static size_t class_size(size_t cls) {
+    return size_t(1) << (cls + kMinClassLog2);
+  }
+
+ public:
+  explicit PacketPool(std::shared_ptr<Budget> budget_)
+      : budget{std::move(budget_)} {}
+
+  PacketPool(const PacketPool&) = delete;
+  PacketPool& operator=(const PacketPool&) = delete;
+
+  ~PacketPool() {
+    for (auto&& free_list : free_lists) {
+      for (void* block : free_list) {
+        free(block);
+      }
+    }
+    budget->give(counters.cached_bytes);
+  }
+
+  // Returns a buffer of at least size bytes.
+  void* acquire(size_t size) {
+    if (size > kMaxClass) {
+      std::unique_lock<std::mutex> lk{mtx};
+      counters.misses++;
+      counters.outstanding_bytes += size;
+      lk.unlock();
+      return malloc(size);
+    }
+
+    size_t cls = class_of(size);
+    std::unique_lock<std::mutex> lk{mtx};
+    counters.outstanding_bytes += class_size(cls);
+    auto& free_list = free_lists[cls];
+    if (!free_list.empty()) {
+      void* block = free_list.back();
+      free_list.pop_back();
+      counters.hits++;
+      counters.cached_bytes -= class_size(cls);
+      budget->give(class_size(cls));
+      return block;
+    }
+    counters.misses++;
+    lk.unlock();
+    return malloc(class_size(cls));
+  }
+
+  // size must be the size passed to acquire.
+  void release(void* block, size_t size) {
+    if (size > kMaxClass) {
+      std::unique_lock<std::mutex> lk{mtx};
+      counters.outstanding_bytes -= size;
+      lk.unlock();
+      free(block);
+      return;
+    }
+
+    size_t cls = class_of(size);
+    std::unique_lock<std::mutex> lk{mtx};
+    counters.outstanding_bytes -= class_size(cls);
+    if (budget->take(class_size(cls))) {
+      free_lists[cls].push_back(block);
+      counters.cached_bytes += class_size(cls);
+      return;
+    }
+    lk.unlock();
+    free(block);
+  }
+
+  Stats stats() const {
+    std::unique_lock<std::mutex> lk{mtx};
+    return counters;
+  }
+};
+
+}  // namespace a0::logger
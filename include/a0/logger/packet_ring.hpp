@@ -0,0 +1,88 @@
+#pragma once
+
+#include <a0.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace a0::logger {
+
+static inline int64_t mono_ns(const TimeMono& ts) {
+  return int64_t(ts.c->ts.tv_sec) * 1000000000 + ts.c->ts.tv_nsec;
+}
+
+// In-flight packets of a FileLogger, from the oldest undecided packet to the
+// newest received.
+//
+// Each packet is stored once, with an ingest sequence number and its
+// a0_time_mono. Policies refer to packets by sequence number, rather than
+// keeping their own copies. Packets are pushed at the back and popped from
+// the front, in order.
+class PacketRing {
+ public:
+  struct Entry {
+    uint64_t seq;
+    int64_t mono_ns;
+    Packet pkt;
+  };
+
+ private:
+  // Capacity is a power of two, grown as needed and never shrunk.
+  std::vector<std::optional<Entry>> slots;
+  size_t head{0};
+  size_t count{0};
+  uint64_t next_seq{0};
+
+  size_t mask() const {
+    return slots.size() - 1;
+  }
+
+  void grow() {
+    std::vector<std::optional<Entry>> next(std::max<size_t>(16, 2 * slots.size()));
+    for (size_t i = 0; i < count; i++) {
+      next[i] = std::move(slots[(head + i) & mask()]);
+    }
+    slots = std::move(next);
+    head = 0;
+  }
+
+ public:
+  const Entry& push(Packet pkt, int64_t mono_ns) {
+    if (count == slots.size()) {
+      grow();
+    }
+    auto& slot = slots[(head + count) & mask()];
+    slot = Entry{next_seq++, mono_ns, std::move(pkt)};
+    count++;
+    return *slot;
+  }
+
+  bool empty() const {
+    return !count;
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  const Entry& front() const {
+    return *slots[head];
+  }
+
+  void pop_front() {
+    slots[head].reset();
+    head = (head + 1) & mask();
+    count--;
+  }
+
+  void clear() {
+    while (count) {
+      pop_front();
+    }
+  }
+};
+
+}  // namespace a0::logger
@@ -1,20 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <deque>
-#include <memory>
-#include <set>
+#include <utility>
 
 #include "a0/logger/policy.hpp"
 
 namespace a0::logger {
 
 class CountPolicy : public Policy::Base {
-  int save_prev{0};
-  int save_next{0};
-  int cur_next_size{0};
+  uint64_t save_prev{0};
+  uint64_t save_next{0};
 
-  std::deque<std::shared_ptr<a0_packet_t>> history;
-  std::set<std::shared_ptr<a0_packet_t>> to_save;
+  // Sequence number of the next packet to arrive.
+  uint64_t next_seq{0};
+
+  // Half-open [begin, end) seq ranges marked for saving, in order.
+  std::deque<std::pair<uint64_t, uint64_t>> to_save;
 
  public:
   CountPolicy(const nlohmann::json& args) {
@@ -29,31 +31,40 @@ class CountPolicy : public Policy::Base {
     }
   }
 
-  void onpkt(Packet pkt) override {
-    if (cur_next_size > 0) {
-      to_save.insert(pkt.c);
-      cur_next_size--;
-    }
-    history.push_back(pkt.c);
-    if (history.size() > save_prev) {
-      history.pop_front();
-    }
+  void onpkt(const Entry& entry) override {
+    next_seq = entry.seq + 1;
   }
 
-  void ondrop(Packet pkt) override {
-    to_save.erase(pkt.c);
+  void ondrop(const Entry& entry) override {
+    while (!to_save.empty() && to_save.front().second <= entry.seq + 1) {
+      to_save.pop_front();
+    }
   }
 
-  void ontrigger() override {
-    cur_next_size = save_next;
-    to_save.insert(history.begin(), history.end());
+  void ontrigger(int64_t, int64_t) override {
+    uint64_t begin = next_seq - std::min(next_seq, save_prev);
+    uint64_t end = next_seq + save_next;
+    if (begin == end) {
+      return;
+    }
+    if (!to_save.empty() && to_save.back().second >= begin) {
+      to_save.back().second = std::max(to_save.back().second, end);
+    } else {
+      to_save.push_back({begin, end});
+    }
   }
 
-  SaveDecision should_save(Packet pkt) override {
-    if (!to_save.empty() || *to_save.begin() == pkt.c) {
-      return SaveDecision::SAVE;
+  SaveDecision should_save(const Entry& entry) override {
+    for (auto&& [begin, end] : to_save) {
+      if (begin <= entry.seq && entry.seq < end) {
+        return SaveDecision::SAVE;
+      }
+      if (entry.seq < begin) {
+        break;
+      }
     }
-    if (std::find(history.begin(), history.end(), pkt.c) != history.end()) {
+    // A trigger may still arrive while this is among the last save_prev packets.
+    if (entry.seq + save_prev >= next_seq) {
       return SaveDecision::DEFER;
     }
     return SaveDecision::DROP;
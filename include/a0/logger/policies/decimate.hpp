@@ -0,0 +1,139 @@
+#pragma once
+
+#include <a0.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#include "a0/logger/policy.hpp"
+#include "a0/logger/unit_parse.hpp"
+
+namespace a0::logger {
+
+class DecimatePolicy : public Policy::Base {
+  // Zero means unset.
+  int64_t min_period_ns{0};
+  uint64_t every_nth{0};
+  double bytes_per_sec{0};
+
+  bool full_rate_on_resume{false};
+  std::atomic<bool> full_rate{false};
+  // Full rate starts on a resume that follows a pause. Without a control
+  // topic, the Policy resumes once at startup, which isn't a transition.
+  bool paused{false};
+
+  int64_t next_save_ns{0};
+  uint64_t count{0};
+  double tokens{0};
+  int64_t last_refill_ns{0};
+
+  // Seqs of received packets chosen for saving, in order.
+  std::deque<uint64_t> to_save;
+
+  bool decide(const Entry& entry) {
+    auto ts = entry.mono_ns;
+    bool save = true;
+
+    if (every_nth) {
+      save &= (count++ % every_nth) == 0;
+    }
+
+    if (min_period_ns) {
+      save &= ts >= next_save_ns;
+    }
+
+    if (bytes_per_sec) {
+      if (last_refill_ns) {
+        tokens = std::min(bytes_per_sec, tokens + bytes_per_sec * (ts - last_refill_ns) / 1e9);
+      } else {
+        tokens = bytes_per_sec;
+      }
+      last_refill_ns = std::max(last_refill_ns, ts);
+      // Any balance will do. The bucket goes into debt for the rest, so
+      // payloads over bytes_per_sec still get through, at the average rate.
+      save &= tokens > 0;
+    }
+
+    save |= full_rate;
+
+    if (save) {
+      if (min_period_ns) {
+        // Keep to a fixed grid, unless we've fallen more than a period behind.
+        next_save_ns += min_period_ns;
+        if (next_save_ns <= ts) {
+          next_save_ns = ts + min_period_ns;
+        }
+      }
+      if (bytes_per_sec) {
+        tokens -= entry.pkt.payload().size();
+        // Saving everything at full rate doesn't count against the budget after.
+        if (full_rate) {
+          tokens = std::max(0.0, tokens);
+        }
+      }
+    }
+    return save;
+  }
+
+ public:
+  DecimatePolicy(const nlohmann::json& args) {
+    if (!args.count("max_rate") && !args.count("every_nth") && !args.count("bytes_per_sec")) {
+      throw std::invalid_argument("DecimatePolicy] Missing at least one of 'max_rate', 'every_nth', or 'bytes_per_sec'");
+    }
+    if (args.count("max_rate")) {
+      auto hz = args["max_rate"].get<double>();
+      if (hz <= 0) {
+        throw std::invalid_argument("DecimatePolicy] max_rate must be positive");
+      }
+      min_period_ns = int64_t(1e9 / hz);
+    }
+    if (args.count("every_nth")) {
+      args["every_nth"].get_to(every_nth);
+      if (!every_nth) {
+        throw std::invalid_argument("DecimatePolicy] every_nth must be positive");
+      }
+    }
+    if (args.count("bytes_per_sec")) {
+      bytes_per_sec = parse_filesize(args["bytes_per_sec"].get<std::string>());
+    }
+    if (args.count("full_rate_on_resume")) {
+      args["full_rate_on_resume"].get_to(full_rate_on_resume);
+    }
+  }
+
+  void onpause() override {
+    paused = true;
+    full_rate = false;
+  }
+
+  void onresume() override {
+    if (paused) {
+      full_rate = full_rate_on_resume;
+    }
+    paused = false;
+  }
+
+  void onpkt(const Entry& entry) override {
+    if (decide(entry)) {
+      to_save.push_back(entry.seq);
+    }
+  }
+
+  void ondrop(const Entry& entry) override {
+    while (!to_save.empty() && to_save.front() <= entry.seq) {
+      to_save.pop_front();
+    }
+  }
+
+  SaveDecision should_save(const Entry& entry) override {
+    if (!to_save.empty() && to_save.front() == entry.seq) {
+      return SaveDecision::SAVE;
+    }
+    return SaveDecision::DROP;
+  }
+};
+
+REGISTER_POLICY(decimate, DecimatePolicy);
+
+}  // namespace a0::logger
@@ -8,7 +8,7 @@ class DropAllPolicy : public Policy::Base {
  public:
   DropAllPolicy(const nlohmann::json&) {}
 
-  SaveDecision should_save(Packet) override {
+  SaveDecision should_save(const Entry&) override {
     return SaveDecision::DROP;
   }
 };
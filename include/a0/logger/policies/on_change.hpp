@@ -0,0 +1,80 @@
+#pragma once
+
+#include <a0.h>
+
+#include <chrono>
+#include <deque>
+
+#include "a0/logger/hash.hpp"
+#include "a0/logger/policy.hpp"
+#include "a0/logger/unit_parse.hpp"
+
+namespace a0::logger {
+
+class OnChangePolicy : public Policy::Base {
+  // Zero means unset.
+  std::chrono::nanoseconds keyframe_interval{0};
+  uint64_t keyframe_every{0};
+
+  bool has_last{false};
+  uint64_t last_hash{0};
+  int64_t last_save_ns{0};
+  uint64_t since_save{0};
+
+  // Seqs of received packets chosen for saving, in order.
+  std::deque<uint64_t> to_save;
+
+  bool decide(const Entry& entry) {
+    auto hash = hash64(entry.pkt.payload());
+    since_save++;
+
+    bool save = !has_last || hash != last_hash;
+    if (has_last && keyframe_interval.count() && last_save_ns + keyframe_interval.count() <= entry.mono_ns) {
+      save = true;
+    }
+    if (keyframe_every && since_save >= keyframe_every) {
+      save = true;
+    }
+
+    if (save) {
+      has_last = true;
+      last_hash = hash;
+      last_save_ns = entry.mono_ns;
+      since_save = 0;
+    }
+    return save;
+  }
+
+ public:
+  OnChangePolicy(const nlohmann::json& args) {
+    if (args.count("keyframe_interval")) {
+      keyframe_interval = parse_duration(args["keyframe_interval"].get<std::string>());
+    }
+    if (args.count("keyframe_every")) {
+      args["keyframe_every"].get_to(keyframe_every);
+    }
+  }
+
+  void onpkt(const Entry& entry) override {
+    if (decide(entry)) {
+      to_save.push_back(entry.seq);
+    }
+  }
+
+  void ondrop(const Entry& entry) override {
+    while (!to_save.empty() && to_save.front() <= entry.seq) {
+      to_save.pop_front();
+    }
+  }
+
+  SaveDecision should_save(const Entry& entry) override {
+    if (!to_save.empty() && to_save.front() == entry.seq) {
+      return SaveDecision::SAVE;
+    }
+    return SaveDecision::DROP;
+  }
+};
+
+REGISTER_POLICY(on_change, OnChangePolicy);
+
+}  // namespace a0::logger
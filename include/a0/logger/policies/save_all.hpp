@@ -25,7 +25,7 @@ class SaveAllPolicy : public Policy::Base {
     enabled = true;
   }
 
-  SaveDecision should_save(Packet) {
+  SaveDecision should_save(const Entry&) {
     return enabled ? SaveDecision::SAVE : SaveDecision::DROP;
   }
 };
@@ -2,9 +2,9 @@
 
 #include <a0.h>
 
+#include <algorithm>
 #include <chrono>
-#include <set>
-#include <sstream>
+#include <deque>
 
 #include "a0/logger/policy.hpp"
 #include "a0/logger/unit_parse.hpp"
@@ -12,11 +12,11 @@
 namespace a0::logger {
 
 class TimePolicy : public Policy::Base {
-  std::chrono::nanoseconds save_prev;
-  std::chrono::nanoseconds save_next;
+  std::chrono::nanoseconds save_prev{0};
+  std::chrono::nanoseconds save_next{0};
 
-  std::deque<TimeMono> trigger_tss;
-  std::deque<std::pair<Packet, TimeMono>> pkt_tss;
+  // Mono time spans of triggers, merged where their windows overlap.
+  std::deque<std::pair<int64_t, int64_t>> trigger_ns;
 
  public:
   TimePolicy(const nlohmann::json& args) {
@@ -31,48 +31,40 @@ class TimePolicy : public Policy::Base {
     }
   }
 
-  void onpkt(Packet pkt) override {
-    for (auto&& [key, val] : pkt.headers()) {
-      if (key == "a0_time_mono") {
-        auto time = TimeMono::parse(val);
-        pkt_tss.push_back({pkt, time});
-        return;
-      }
-    }
-  }
-
-  void ondrop(Packet pkt) override {
-    if (pkt_tss.front().first.c == pkt.c) {
-      pkt_tss.pop_front();
+  void ontrigger(int64_t first_ns, int64_t last_ns) override {
+    if (!trigger_ns.empty() &&
+        first_ns - trigger_ns.back().second <= coalesce_ns() &&
+        trigger_ns.back().first - last_ns <= coalesce_ns()) {
+      auto& back = trigger_ns.back();
+      back = {std::min(back.first, first_ns), std::max(back.second, last_ns)};
+      return;
     }
+    trigger_ns.push_back({first_ns, last_ns});
   }
 
-  void ontrigger() override {
-    trigger_tss.push_back(TimeMono::now());
+  // Windows of triggers closer than this overlap.
+  int64_t coalesce_ns() const override {
+    return (save_prev + save_next).count();
   }
 
-  SaveDecision should_save(Packet pkt) override {
-    if (pkt_tss.empty() || pkt_tss.front().first.c != pkt.c) {
-      return SaveDecision::DROP;
-    }
-
-    TimeMono pkt_ts = pkt_tss.front().second;
+  SaveDecision should_save(const Entry& entry) override {
+    const int64_t pkt_ns = entry.mono_ns;
 
     // Do some cleanup.
-    while (!trigger_tss.empty() && trigger_tss.front() + save_next < pkt_ts) {
-      trigger_tss.pop_front();
+    while (!trigger_ns.empty() && trigger_ns.front().second + save_next.count() < pkt_ns) {
+      trigger_ns.pop_front();
     }
 
     // Check if any windows match.
-    for (auto& trig_ts : trigger_tss) {
-      if (trig_ts - save_prev <= pkt_ts && pkt_ts <= trig_ts + save_next) {
+    for (auto [first_ns, last_ns] : trigger_ns) {
+      if (first_ns - save_prev.count() <= pkt_ns && pkt_ns <= last_ns + save_next.count()) {
         return SaveDecision::SAVE;
       }
     }
 
     // No trigger has marked this message for saving.
     // If a trigger can still save it, defer. Otherwise drop.
-    if (TimeMono::now() < pkt_ts + save_prev) {
+    if (mono_ns(TimeMono::now()) < pkt_ns + save_prev.count()) {
       return SaveDecision::DEFER;
     }
     return SaveDecision::DROP;
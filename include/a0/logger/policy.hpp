@@ -3,10 +3,20 @@
 #include <a0.h>
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
+#include "a0/logger/packet_ring.hpp"
 #include "a0/logger/trigger.hpp"
+#include "a0/logger/unit_parse.hpp"
 
 namespace a0::logger {
 
@@ -23,13 +33,34 @@ class Policy final : public Trigger::Listener {
     nlohmann::json args;
     std::vector<Trigger::Config> triggers;
     std::string trigger_control_topic;
+    // Triggers closer together than this are ignored.
+    std::chrono::nanoseconds min_interval{0};
   };
 
-  struct Base : Trigger::Listener {
+  using Entry = PacketRing::Entry;
+
+  // Packets are owned by the FileLogger's PacketRing. Policies should track
+  // them by entry.seq, which increases by one per packet received.
+  // ondrop is called in seq order, once the packet leaves the ring.
+  //
+  // All methods are called with the FileLogger mutex held.
+  struct Base {
+    using Entry = PacketRing::Entry;
+
     virtual ~Base() = default;
-    virtual void onpkt(Packet) {}
-    virtual void ondrop(Packet) {}
-    virtual SaveDecision should_save(Packet) = 0;
+    virtual void onpause() {}
+    virtual void onresume() {}
+    // Triggers fired since the previous packet, before that packet is seen.
+    // Triggers within coalesce_ns() of one another are combined into one
+    // call. first_ns and last_ns are the mono times of the first and last of
+    // them. A span is delivered again, grown, if more triggers join it.
+    virtual void ontrigger(int64_t /* first_ns */, int64_t /* last_ns */) {}
+    // How close triggers must be for their effects to overlap. Policies that
+    // ignore the trigger times may combine all of them.
+    virtual int64_t coalesce_ns() const { return std::numeric_limits<int64_t>::max(); }
+    virtual void onpkt(const Entry&) {}
+    virtual void ondrop(const Entry&) {}
+    virtual SaveDecision should_save(const Entry&) = 0;
   };
 
   using Factory = std::function<std::unique_ptr<Base>(nlohmann::json)>;
@@ -46,7 +77,7 @@ class Policy final : public Trigger::Listener {
   Policy(Config config,
          std::mutex* mtx_,
          std::vector<std::string> trigger_control_topics)
-      : mtx{mtx_} {
+      : mtx{mtx_}, trigger_cfgs{config.triggers}, min_interval{config.min_interval} {
     if (!registrar()->count(config.type)) {
       throw std::invalid_argument("Unknown policy: " + config.type);
     }
@@ -63,26 +94,89 @@ class Policy final : public Trigger::Listener {
     for (auto&& trigger_control_topic : trigger_control_topics) {
       Trigger::Gate::get(trigger_control_topic)->add_listener(this);
     }
+    gate_topics = trigger_control_topics;
 
     base = registrar()->at(config.type)(config.args);
+    coalesce_ns = base->coalesce_ns();
     if (trigger_control_topics.empty()) {
       onresume();
     } else {
       onpause();
     }
+  }
 
-    for (auto&& tcfg : config.triggers) {
+  // Threads started by triggers inherit the scheduling of the calling thread.
+  void start_triggers() {
+    for (auto&& tcfg : trigger_cfgs) {
       triggers.emplace_back(tcfg, this);
     }
   }
 
-  void onpkt(Packet pkt) { base->onpkt(pkt); }
-  void ondrop(Packet pkt) { base->ondrop(pkt); }
+  ~Policy() {
+    // Policies may be rebuilt on reconfigure. Gates outlive them.
+    for (auto&& topic : gate_topics) {
+      Trigger::Gate::get(topic)->remove_listener(this);
+    }
+  }
+
+  // Counts started triggers by whether they run on threads shared with
+  // other rules.
+  size_t num_triggers(bool shared) const {
+    return std::count_if(triggers.begin(), triggers.end(), [&](const Trigger& t) { return t.shared_thread() == shared; });
+  }
+
+  void onpkt(const Entry& entry) { base->onpkt(entry); }
+  void ondrop(const Entry& entry) { base->ondrop(entry); }
+  // Called on trigger threads. The trigger is only recorded, and applied by
+  // consume_triggers on the packet path. A trigger that joins the open span
+  // takes no locks. One that starts a new span takes spans_mtx.
   void ontrigger() override {
-    std::unique_lock<std::mutex> lk{*mtx};
-    if (triggers_enabled) {
-      base->ontrigger();
+    if (!triggers_enabled) {
+      return;
+    }
+    int64_t now = mono_ns(TimeMono::now());
+    if (min_interval.count()) {
+      int64_t last = last_fire_ns;
+      if (now - last < min_interval.count() || !last_fire_ns.compare_exchange_strong(last, now)) {
+        return;
+      }
+    }
+    if (!try_join(now)) {
+      std::unique_lock<std::mutex> lk{spans_mtx};
+      if (!try_join(now)) {
+        start_span(now);
+      }
+    }
+    num_fired.fetch_add(1, std::memory_order_release);
+  }
+
+  // Applies triggers fired since the previous call. Called with mtx held.
+  void consume_triggers() {
+    uint64_t fired = num_fired.load(std::memory_order_acquire);
+    if (fired == num_consumed) {
+      return;
+    }
+    num_consumed = fired;
+
+    std::vector<Span> spans;
+    Span open;
+    {
+      std::unique_lock<std::mutex> lk{spans_mtx};
+      spans.swap(closed_spans);
+      open = {open_first_ns, open_last_ns};
+    }
+    if (open.first) {
+      spans.push_back(open);
     }
+    std::sort(spans.begin(), spans.end());
+    for (auto&& span : spans) {
+      // Unchanged since it was delivered as the open span.
+      if (span == delivered) {
+        continue;
+      }
+      base->ontrigger(span.first, span.second);
+    }
+    delivered = open;
   }
   void onpause() override {
     std::unique_lock<std::mutex> lk{*mtx};
@@ -94,13 +188,96 @@ class Policy final : public Trigger::Listener {
     triggers_enabled = true;
     base->onresume();
   }
-  SaveDecision should_save(Packet pkt) { return base->should_save(pkt); }
+  SaveDecision should_save(const Entry& entry) { return base->should_save(entry); }
 
  private:
   std::mutex* mtx;
   std::unique_ptr<Base> base;
+  std::vector<Trigger::Config> trigger_cfgs;
   std::vector<Trigger> triggers;
-  bool triggers_enabled{true};
+  std::vector<std::string> gate_topics;
+  std::atomic<bool> triggers_enabled{true};
+
+  const std::chrono::nanoseconds min_interval;
+  std::atomic<int64_t> last_fire_ns{INT64_MIN / 2};
+
+  // Mono times of the first and last trigger of a span.
+  using Span = std::pair<int64_t, int64_t>;
+  // Past this many, new spans are merged into the last one.
+  static constexpr size_t kMaxClosedSpans = 1024;
+
+  int64_t coalesce_ns{0};
+
+  // Written by trigger threads, consumed on the packet path.
+  // Triggers widen the open span with CAS. Replacing it takes spans_mtx,
+  // and makes span_version odd meanwhile.
+  std::atomic<int64_t> open_first_ns{0};
+  std::atomic<int64_t> open_last_ns{0};
+  std::atomic<uint64_t> span_version{0};
+  std::mutex spans_mtx;
+  std::vector<Span> closed_spans;
+  std::atomic<uint64_t> num_fired{0};
+  uint64_t num_consumed{0};
+  Span delivered{0, 0};
+
+  // Widens the open span to cover now, if now is within coalesce_ns of it.
+  bool try_join(int64_t now) {
+    while (true) {
+      uint64_t version = span_version;
+      int64_t first = open_first_ns;
+      int64_t last = open_last_ns;
+      if ((version & 1) || version != span_version) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (!first) {
+        return false;
+      }
+      // A replaced span fails the CAS, and is read again.
+      if (now > last) {
+        if (now - last > coalesce_ns) {
+          return false;
+        }
+        if (open_last_ns.compare_exchange_weak(last, now)) {
+          return true;
+        }
+      } else if (now < first) {
+        if (first - now > coalesce_ns) {
+          return false;
+        }
+        if (open_first_ns.compare_exchange_weak(first, now)) {
+          return true;
+        }
+      } else {
+        return true;
+      }
+    }
+  }
+
+  // Called with spans_mtx held, when now is out of reach of the open span.
+  void start_span(int64_t now) {
+    // Triggers can be seen out of order. One far before the open span gets
+    // its own.
+    if (open_first_ns && now < open_first_ns) {
+      close_span({now, now});
+      return;
+    }
+    span_version++;
+    Span prev{open_first_ns.exchange(now), open_last_ns.exchange(now)};
+    span_version++;
+    if (prev.first) {
+      close_span(prev);
+    }
+  }
+
+  void close_span(Span span) {
+    if (closed_spans.size() < kMaxClosedSpans) {
+      closed_spans.push_back(span);
+      return;
+    }
+    auto& back = closed_spans.back();
+    back = {std::min(back.first, span.first), std::max(back.second, span.second)};
+  }
 };
 
 A0_STATIC_INLINE
@@ -115,6 +292,9 @@ void from_json(const nlohmann::json& j, Policy::Config& t) {
   if (j.count("trigger_control_topic")) {
     j.at("trigger_control_topic").get_to(t.trigger_control_topic);
   }
+  if (j.count("min_interval")) {
+    t.min_interval = parse_duration(j.at("min_interval"));
+  }
 }
 
 }  // namespace a0::logger
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <a0.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "a0/logger/packet_pool.hpp"
+
+namespace a0::logger {
+
+// Like a0::Reader, reading from the oldest packet, but packet buffers come
+// from a PacketPool and return to it when the Packet is released.
+class PooledReader {
+  std::shared_ptr<PacketPool> pool;
+  std::function<void(Packet)> onpacket;
+  File file;
+
+  // Buffers allocated by the reader and not yet handed to a Packet. Only
+  // used on the reader thread, or once it has stopped.
+  std::vector<a0_buf_t> unclaimed;
+  a0_reader_t c{};
+
+  static a0_err_t alloc(void* user_data, size_t size, a0_buf_t* out) {
+    auto* self = static_cast<PooledReader*>(user_data);
+    out->data = static_cast<uint8_t*>(self->pool->acquire(size));
+    out->size = size;
+    self->unclaimed.push_back(*out);
+    return A0_OK;
+  }
+
+  // Buffers claimed by a Packet are returned by its deleter. Others, whose
+  // packet was never delivered, are returned here.
+  static a0_err_t dealloc(void* user_data, a0_buf_t buf) {
+    auto* self = static_cast<PooledReader*>(user_data);
+    auto it = std::find_if(self->unclaimed.begin(), self->unclaimed.end(), [&](const a0_buf_t& b) {
+      return b.data == buf.data;
+    });
+    if (it != self->unclaimed.end()) {
+      self->unclaimed.erase(it);
+      self->pool->release(buf.data, buf.size);
+    }
+    return A0_OK;
+  }
+
+  static void onpkt(void* user_data, a0_packet_t pkt) {
+    auto* self = static_cast<PooledReader*>(user_data);
+    // The packet is deserialized into the buffer that holds its payload.
+    auto it = std::find_if(self->unclaimed.begin(), self->unclaimed.end(), [&](const a0_buf_t& b) {
+      return b.data <= pkt.payload.data && pkt.payload.data <= b.data + b.size;
+    });
+    if (it == self->unclaimed.end()) {
+      // Not allocated here. Nothing to return.
+      self->onpacket(Packet(pkt, [](a0_packet_t*) {}));
+      return;
+    }
+    auto buf = *it;
+    self->unclaimed.erase(it);
+    self->onpacket(Packet(pkt, [pool = self->pool, buf](a0_packet_t*) {
+      pool->release(buf.data, buf.size);
+    }));
+  }
+
+ public:
+  PooledReader(File file_, std::shared_ptr<PacketPool> pool_, std::function<void(Packet)> onpacket_)
+      : pool{std::move(pool_)}, onpacket{std::move(onpacket_)}, file{std::move(file_)} {
+    a0_err_t err = a0_reader_init(
+        &c,
+        file.c->arena,
+        a0_alloc_t{this, &PooledReader::alloc, &PooledReader::dealloc},
+        a0_reader_options_t{A0_INIT_OLDEST, A0_ITER_NEXT},
+        a0_packet_callback_t{this, &PooledReader::onpkt});
+    if (err) {
+      throw std::runtime_error(std::string("PooledReader] ") + a0_strerror(err));
+    }
+  }
+
+  PooledReader(const PooledReader&) = delete;
+  PooledReader& operator=(const PooledReader&) = delete;
+
+  // Blocks until any callback in progress completes.
+  ~PooledReader() {
+    a0_reader_close(&c);
+    for (auto&& buf : unclaimed) {
+      pool->release(buf.data, buf.size);
+    }
+  }
+};
+
+}  // namespace a0::logger
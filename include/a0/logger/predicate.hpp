@@ -0,0 +1,349 @@
+#pragma once
+
+#include <yyjson.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace a0::logger {
+
+// A condition on fields of a JSON payload, compiled once and evaluated per
+// packet. For example:
+//
+//   speed > 20
+//   fault_code != 0 || state.mode == "estop"
+//   wheels[0].rpm >= 3000 && !(gear == "park")
+//
+// Comparisons take a field path on the left and a literal on the right:
+// a number, a "string", true, false, or null. Numbers compare as doubles.
+// Strings support all six operators, other literals only == and !=.
+// A comparison is false if the field is missing or of a different type.
+class Predicate {
+  struct Step {
+    std::string key;
+    // Set for an array index, instead of a key.
+    std::optional<size_t> index;
+  };
+
+  struct Null {};
+  using Literal = std::variant<Null, bool, double, std::string>;
+
+  enum class Op {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+  };
+
+  struct Node {
+    enum class Kind {
+      AND,
+      OR,
+      NOT,
+      CMP,
+    } kind;
+    std::unique_ptr<Node> lhs;
+    std::unique_ptr<Node> rhs;
+
+    std::vector<Step> path;
+    Op op;
+    Literal literal;
+  };
+
+  std::string source;
+  std::unique_ptr<Node> root;
+
+  class Parser {
+    std::string_view src;
+    size_t pos{0};
+
+    [[noreturn]] void fail(const std::string& what) {
+      throw std::invalid_argument("Predicate] " + what + " at position " + std::to_string(pos) + ": " + std::string(src));
+    }
+
+    void skip_ws() {
+      while (pos < src.size() && isspace(src[pos])) {
+        pos++;
+      }
+    }
+
+    bool eat(std::string_view tok) {
+      skip_ws();
+      if (src.substr(pos, tok.size()) == tok) {
+        pos += tok.size();
+        return true;
+      }
+      return false;
+    }
+
+    static bool is_ident(char c) {
+      return isalnum(c) || c == '_' || c == '-';
+    }
+
+    std::unique_ptr<Node> binary(Node::Kind kind, std::unique_ptr<Node> lhs, std::unique_ptr<Node> rhs) {
+      auto node = std::make_unique<Node>();
+      node->kind = kind;
+      node->lhs = std::move(lhs);
+      node->rhs = std::move(rhs);
+      return node;
+    }
+
+    std::unique_ptr<Node> parse_or() {
+      auto node = parse_and();
+      while (eat("||")) {
+        node = binary(Node::Kind::OR, std::move(node), parse_and());
+      }
+      return node;
+    }
+
+    std::unique_ptr<Node> parse_and() {
+      auto node = parse_unary();
+      while (eat("&&")) {
+        node = binary(Node::Kind::AND, std::move(node), parse_unary());
+      }
+      return node;
+    }
+
+    std::unique_ptr<Node> parse_unary() {
+      if (eat("!")) {
+        return binary(Node::Kind::NOT, parse_unary(), nullptr);
+      }
+      if (eat("(")) {
+        auto node = parse_or();
+        if (!eat(")")) {
+          fail("Expected ')'");
+        }
+        return node;
+      }
+      return parse_cmp();
+    }
+
+    std::vector<Step> parse_path() {
+      std::vector<Step> path;
+      skip_ws();
+      while (true) {
+        size_t start = pos;
+        while (pos < src.size() && is_ident(src[pos])) {
+          pos++;
+        }
+        if (pos == start) {
+          fail("Expected field name");
+        }
+        path.push_back({std::string(src.substr(start, pos - start)), std::nullopt});
+        while (pos < src.size() && src[pos] == '[') {
+          pos++;
+          size_t idx_start = pos;
+          while (pos < src.size() && isdigit(src[pos])) {
+            pos++;
+          }
+          if (pos == idx_start || pos >= src.size() || src[pos] != ']') {
+            fail("Expected array index");
+          }
+          path.push_back({"", std::stoull(std::string(src.substr(idx_start, pos - idx_start)))});
+          pos++;
+        }
+        if (pos < src.size() && src[pos] == '.') {
+          pos++;
+          continue;
+        }
+        return path;
+      }
+    }
+
+    Op parse_op() {
+      // Two character operators first.
+      if (eat("==")) {
+        return Op::EQ;
+      }
+      if (eat("!=")) {
+        return Op::NE;
+      }
+      if (eat("<=")) {
+        return Op::LE;
+      }
+      if (eat(">=")) {
+        return Op::GE;
+      }
+      if (eat("<")) {
+        return Op::LT;
+      }
+      if (eat(">")) {
+        return Op::GT;
+      }
+      fail("Expected comparison operator");
+    }
+
+    Literal parse_literal() {
+      skip_ws();
+      if (eat("true")) {
+        return true;
+      }
+      if (eat("false")) {
+        return false;
+      }
+      if (eat("null")) {
+        return Null{};
+      }
+      if (pos < src.size() && src[pos] == '"') {
+        std::string str;
+        for (pos++; pos < src.size() && src[pos] != '"'; pos++) {
+          if (src[pos] == '\\' && pos + 1 < src.size()) {
+            pos++;
+          }
+          str += src[pos];
+        }
+        if (pos >= src.size()) {
+          fail("Unterminated string");
+        }
+        pos++;
+        return str;
+      }
+      std::string rest(src.substr(pos));
+      char* end;
+      double val = std::strtod(rest.c_str(), &end);
+      if (end == rest.c_str()) {
+        fail("Expected literal");
+      }
+      pos += end - rest.c_str();
+      return val;
+    }
+
+    std::unique_ptr<Node> parse_cmp() {
+      auto node = std::make_unique<Node>();
+      node->kind = Node::Kind::CMP;
+      node->path = parse_path();
+      node->op = parse_op();
+      node->literal = parse_literal();
+      if (!std::holds_alternative<double>(node->literal) &&
+          !std::holds_alternative<std::string>(node->literal) &&
+          node->op != Op::EQ && node->op != Op::NE) {
+        fail("Only == and != apply to true, false, and null");
+      }
+      return node;
+    }
+
+   public:
+    explicit Parser(std::string_view src_)
+        : src{src_} {}
+
+    std::unique_ptr<Node> parse() {
+      auto node = parse_or();
+      skip_ws();
+      if (pos != src.size()) {
+        fail("Unexpected input");
+      }
+      return node;
+    }
+  };
+
+  template <typename T>
+  static bool compare(Op op, const T& lhs, const T& rhs) {
+    switch (op) {
+      case Op::EQ:
+        return lhs == rhs;
+      case Op::NE:
+        return lhs != rhs;
+      case Op::LT:
+        return lhs < rhs;
+      case Op::LE:
+        return lhs <= rhs;
+      case Op::GT:
+        return lhs > rhs;
+      case Op::GE:
+        return lhs >= rhs;
+    }
+    return false;
+  }
+
+  static yyjson_val* resolve(yyjson_val* val, const std::vector<Step>& path) {
+    for (auto&& step : path) {
+      if (!val) {
+        return nullptr;
+      }
+      if (step.index) {
+        val = yyjson_is_arr(val) ? yyjson_arr_get(val, *step.index) : nullptr;
+      } else {
+        val = yyjson_is_obj(val) ? yyjson_obj_getn(val, step.key.data(), step.key.size()) : nullptr;
+      }
+    }
+    return val;
+  }
+
+  static bool eval_cmp(const Node& node, yyjson_val* root) {
+    yyjson_val* val = resolve(root, node.path);
+    if (!val) {
+      return false;
+    }
+    if (auto* num = std::get_if<double>(&node.literal)) {
+      double field;
+      if (yyjson_is_real(val)) {
+        field = yyjson_get_real(val);
+      } else if (yyjson_is_uint(val)) {
+        field = double(yyjson_get_uint(val));
+      } else if (yyjson_is_sint(val)) {
+        field = double(yyjson_get_sint(val));
+      } else {
+        return false;
+      }
+      return compare(node.op, field, *num);
+    }
+    if (auto* str = std::get_if<std::string>(&node.literal)) {
+      if (!yyjson_is_str(val)) {
+        return false;
+      }
+      return compare(node.op, std::string_view(yyjson_get_str(val), yyjson_get_len(val)), std::string_view(*str));
+    }
+    if (auto* b = std::get_if<bool>(&node.literal)) {
+      if (!yyjson_is_bool(val)) {
+        return false;
+      }
+      return compare(node.op, yyjson_get_bool(val), *b);
+    }
+    return compare(node.op, yyjson_is_null(val), true);
+  }
+
+  static bool eval_node(const Node& node, yyjson_val* root) {
+    switch (node.kind) {
+      case Node::Kind::AND:
+        return eval_node(*node.lhs, root) && eval_node(*node.rhs, root);
+      case Node::Kind::OR:
+        return eval_node(*node.lhs, root) || eval_node(*node.rhs, root);
+      case Node::Kind::NOT:
+        return !eval_node(*node.lhs, root);
+      case Node::Kind::CMP:
+        return eval_cmp(node, root);
+    }
+    return false;
+  }
+
+ public:
+  // Throws std::invalid_argument if the predicate doesn't parse.
+  explicit Predicate(std::string source_)
+      : source{std::move(source_)}, root{Parser(source).parse()} {}
+
+  const std::string& str() const {
+    return source;
+  }
+
+  // Returns nullopt if the payload is not valid JSON.
+  std::optional<bool> eval(std::string_view payload) const {
+    yyjson_doc* doc = yyjson_read(payload.data(), payload.size(), YYJSON_READ_NOFLAG);
+    if (!doc) {
+      return std::nullopt;
+    }
+    bool result = eval_node(*root, yyjson_doc_get_root(doc));
+    yyjson_doc_free(doc);
+    return result;
+  }
+};
+
+}  // namespace a0::logger
@@ -9,6 +9,7 @@
 #include <optional>
 
 #include "a0/logger/policy.hpp"
+#include "a0/logger/scheduling.hpp"
 #include "a0/logger/unit_parse.hpp"
 
 namespace a0::logger {
@@ -37,10 +38,20 @@ struct Rule {
 
   std::optional<uint64_t> max_logfile_size;
   std::optional<std::chrono::nanoseconds> max_logfile_duration;
+  std::optional<std::string> encoding;
 
   std::vector<a0::logger::Policy::Config> policies;
   std::string trigger_control_topic;
 
+  // Under sustained reader lag, lower priority rules are shed first.
+  int priority{0};
+
+  // Overrides the global scheduling, field by field.
+  Scheduling scheduling;
+
+  // Share of the global io_budget, relative to other rules.
+  double io_weight{1};
+
   std::string relative_watch_path() const {
     static std::map<Protocol, std::string> tmpl_map{
         {Protocol::FILE, "{topic}"},
@@ -81,9 +92,27 @@ static inline void from_json(const nlohmann::json& j, Rule& r) {
   if (j.count("max_logfile_duration")) {
     r.max_logfile_duration = parse_duration(j.at("max_logfile_duration"));
   }
+  if (j.count("encoding")) {
+    r.encoding = j.at("encoding").get<std::string>();
+    if (*r.encoding != "a0" && *r.encoding != "compact") {
+      throw std::invalid_argument("Unknown encoding: " + *r.encoding + ". Known: a0, compact");
+    }
+  }
   if (j.count("trigger_control_topic")) {
     r.trigger_control_topic = j.at("trigger_control_topic");
   }
+  if (j.count("priority")) {
+    j.at("priority").get_to(r.priority);
+  }
+  if (j.count("scheduling")) {
+    j.at("scheduling").get_to(r.scheduling);
+  }
+  if (j.count("io_weight")) {
+    j.at("io_weight").get_to(r.io_weight);
+    if (r.io_weight <= 0) {
+      throw std::invalid_argument("io_weight must be positive");
+    }
+  }
 }
 
 static inline void to_json(nlohmann::json j, const Rule& r) {
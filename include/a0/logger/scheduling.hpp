@@ -0,0 +1,248 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace a0::logger {
+
+// CPU affinity, priority, and I/O priority for the threads of a FileLogger.
+//
+// Threads inherit these settings from the thread that creates them, so they
+// are applied by starting threads from within start_threads.
+// Unset fields leave the thread's inherited value alone.
+struct Scheduling {
+  std::optional<std::vector<int>> cpus;
+  std::optional<int> nice;
+  // If set, the thread runs SCHED_FIFO at this priority. nice is then ignored.
+  std::optional<int> fifo_priority;
+  // One of "rt", "be", "idle".
+  std::optional<std::string> ioprio_class;
+  std::optional<int> ioprio_level;
+
+  bool empty() const {
+    return !cpus && !nice && !fifo_priority && !ioprio_class && !ioprio_level;
+  }
+
+  // Fields set here take precedence over those set in fallback.
+  Scheduling over(const Scheduling& fallback) const {
+    Scheduling s = *this;
+    if (!s.cpus) {
+      s.cpus = fallback.cpus;
+    }
+    if (!s.nice) {
+      s.nice = fallback.nice;
+    }
+    if (!s.fifo_priority) {
+      s.fifo_priority = fallback.fifo_priority;
+    }
+    if (!s.ioprio_class) {
+      s.ioprio_class = fallback.ioprio_class;
+    }
+    if (!s.ioprio_level) {
+      s.ioprio_level = fallback.ioprio_level;
+    }
+    return s;
+  }
+
+  // Linux IOPRIO_CLASS_* value, or -1 if unknown.
+  static int ioprio_class_id(const std::string& name) {
+    if (name == "rt") {
+      return 1;
+    }
+    if (name == "be") {
+      return 2;
+    }
+    if (name == "idle") {
+      return 3;
+    }
+    return -1;
+  }
+
+  // Calls fn on a new thread with these settings applied. Threads started by
+  // fn run with them from their first instruction.
+  // Returns the settings in effect, as apply() does.
+  nlohmann::json start_threads(const std::function<void()>& fn) const {
+    nlohmann::json effective;
+    std::exception_ptr err;
+    std::thread([&]() {
+      effective = apply();
+      try {
+        fn();
+      } catch (...) {
+        err = std::current_exception();
+      }
+    }).join();
+    if (err) {
+      std::rethrow_exception(err);
+    }
+    return effective;
+  }
+
+  // Applies the settings to the calling thread.
+  // Returns the settings now in effect, as read back from the kernel, along
+  // with any errors. Lacking CAP_SYS_NICE is the usual cause of failure.
+  nlohmann::json apply() const {
+    std::vector<std::string> errors;
+    auto fail = [&](const char* what) {
+      errors.push_back(std::string(what) + ": " + std::strerror(errno));
+    };
+
+    pid_t tid = syscall(SYS_gettid);
+
+    if (cpus) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu : *cpus) {
+        CPU_SET(cpu, &set);
+      }
+      if (int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        errno = err;
+        fail("cpus");
+      }
+    }
+    if (fifo_priority) {
+      sched_param param{};
+      param.sched_priority = *fifo_priority;
+      if (int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        errno = err;
+        fail("fifo_priority");
+      }
+    } else if (nice) {
+      // On Linux, nice is per-thread when addressed by tid.
+      if (setpriority(PRIO_PROCESS, tid, *nice) != 0) {
+        fail("nice");
+      }
+    }
+    if (ioprio_class || ioprio_level) {
+      if (syscall(SYS_ioprio_set, kIoprioWhoProcess, tid, ioprio_value()) != 0) {
+        fail("ioprio");
+      }
+    }
+
+    return effective(tid, errors);
+  }
+
+ private:
+  static constexpr int kIoprioWhoProcess = 1;
+  static constexpr int kIoprioClassShift = 13;
+
+  int ioprio_value() const {
+    int cls = ioprio_class_id(ioprio_class.value_or("be"));
+    return (cls << kIoprioClassShift) | ioprio_level.value_or(4);
+  }
+
+  static nlohmann::json effective(pid_t tid, const std::vector<std::string>& errors) {
+    nlohmann::json j;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+      std::vector<int> on;
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+          on.push_back(cpu);
+        }
+      }
+      j["cpus"] = on;
+    }
+
+    int policy;
+    sched_param param{};
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+      j["policy"] = policy == SCHED_FIFO ? "fifo" : policy == SCHED_RR ? "rr" : "other";
+      if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        j["fifo_priority"] = param.sched_priority;
+      }
+    }
+
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, tid);
+    if (errno == 0) {
+      j["nice"] = nice;
+    }
+
+    long ioprio = syscall(SYS_ioprio_get, kIoprioWhoProcess, tid);
+    if (ioprio >= 0) {
+      static const char* kClassNames[] = {"none", "rt", "be", "idle"};
+      j["ioprio_class"] = kClassNames[(ioprio >> kIoprioClassShift) & 3];
+      j["ioprio_level"] = ioprio & ((1 << kIoprioClassShift) - 1);
+    }
+
+    if (!errors.empty()) {
+      j["errors"] = errors;
+    }
+    return j;
+  }
+};
+
+// cpus may be a list, ex. [2, 3], or a string, ex. "2-3,6".
+static inline std::vector<int> parse_cpus(const nlohmann::json& j) {
+  if (j.is_array()) {
+    return j.get<std::vector<int>>();
+  }
+  std::vector<int> cpus;
+  std::stringstream ss(j.get<std::string>());
+  std::string part;
+  while (std::getline(ss, part, ',')) {
+    auto dash = part.find('-');
+    int lo = std::stoi(part.substr(0, dash));
+    int hi = dash == std::string::npos ? lo : std::stoi(part.substr(dash + 1));
+    for (int cpu = lo; cpu <= hi; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+static inline void from_json(const nlohmann::json& j, Scheduling& s) {
+  if (j.count("cpus")) {
+    s.cpus = parse_cpus(j.at("cpus"));
+    for (int cpu : *s.cpus) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        throw std::invalid_argument("Scheduling] Invalid cpu: " + std::to_string(cpu));
+      }
+    }
+  }
+  if (j.count("nice")) {
+    s.nice = j.at("nice").get<int>();
+    if (*s.nice < -20 || *s.nice > 19) {
+      throw std::invalid_argument("Scheduling] nice must be in [-20, 19]");
+    }
+  }
+  if (j.count("fifo_priority")) {
+    s.fifo_priority = j.at("fifo_priority").get<int>();
+    if (*s.fifo_priority < sched_get_priority_min(SCHED_FIFO) || *s.fifo_priority > sched_get_priority_max(SCHED_FIFO)) {
+      throw std::invalid_argument("Scheduling] fifo_priority out of range");
+    }
+  }
+  if (j.count("ioprio_class")) {
+    s.ioprio_class = j.at("ioprio_class").get<std::string>();
+    if (Scheduling::ioprio_class_id(*s.ioprio_class) < 0) {
+      throw std::invalid_argument("Scheduling] Unknown ioprio_class: " + *s.ioprio_class + ". Known: rt, be, idle");
+    }
+  }
+  if (j.count("ioprio_level")) {
+    s.ioprio_level = j.at("ioprio_level").get<int>();
+    if (*s.ioprio_level < 0 || *s.ioprio_level > 7) {
+      throw std::invalid_argument("Scheduling] ioprio_level must be in [0, 7]");
+    }
+  }
+}
+
+}  // namespace a0::logger
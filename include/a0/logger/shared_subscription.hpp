@@ -0,0 +1,225 @@
+#pragma once
+
+#include <a0.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "a0/logger/scheduling.hpp"
+#include "a0/logger/thread_pool.hpp"
+
+namespace a0::logger {
+
+// One Subscriber per topic, shared by every trigger that listens to it.
+//
+// Every message is read, in order. Listeners that only care that something
+// arrived, like the pubsub trigger, are notified per message; a backlog of
+// notifications coalesces in the Policy.
+//
+// The subscriber thread fans out to the listener list without locks or
+// reference counting. Updates swap in a new list, then wait out any fan-out
+// that may still see the old one, before freeing it. Listeners are added and
+// removed rarely, when rules are (re)built.
+//
+// The subscriber threads serve many rules, so they can't take any one rule's
+// scheduling. They run with the global scheduling, set by set_scheduling.
+class SharedSubscription {
+ public:
+  using Callback = std::function<void(Packet)>;
+  // Called with the settings each new subscriber thread starts with.
+  using OnScheduled = std::function<void(const std::string& topic, const nlohmann::json& effective)>;
+
+ private:
+  using Listeners = std::vector<const Callback*>;
+
+  // Guards updates to listeners. Never taken by the subscriber thread.
+  std::mutex write_mtx;
+  // The current list, owned here, and published to the subscriber thread.
+  std::unique_ptr<const Listeners> owned{std::make_unique<const Listeners>()};
+  std::atomic<const Listeners*> listeners{owned.get()};
+  // Odd while the subscriber thread is fanning out.
+  std::atomic<uint64_t> fanout_seq{0};
+  Subscriber sub;
+
+  // Both sides use seq_cst: either the fan-out loads the new list, or the
+  // writer sees the fan-out in progress and waits for it.
+  void update(std::unique_ptr<const Listeners> next) {
+    listeners = next.get();
+    uint64_t seq = fanout_seq.load();
+    if (seq & 1) {
+      while (fanout_seq.load() == seq) {
+        std::this_thread::yield();
+      }
+    }
+    owned = std::move(next);
+  }
+
+  void add(const Callback* cb) {
+    std::unique_lock<std::mutex> lk{write_mtx};
+    auto next = std::make_unique<Listeners>(*owned);
+    next->push_back(cb);
+    update(std::move(next));
+  }
+
+  // Once this returns, cb is not running, and won't be called again.
+  // Returns the number of listeners left.
+  size_t remove(const Callback* cb) {
+    std::unique_lock<std::mutex> lk{write_mtx};
+    auto next = std::make_unique<Listeners>(*owned);
+    next->erase(std::remove(next->begin(), next->end(), cb), next->end());
+    size_t left = next->size();
+    update(std::move(next));
+    return left;
+  }
+
+  struct Registry {
+    std::mutex mtx;
+    std::map<std::string, std::unique_ptr<SharedSubscription>> subs;
+    // Subscribers are started from this thread, and inherit its scheduling,
+    // rather than that of whichever rule subscribed first.
+    std::unique_ptr<ThreadPool> starter;
+    nlohmann::json effective;
+    OnScheduled onscheduled;
+  };
+
+  static Registry& registry() {
+    static Registry r;
+    return r;
+  }
+
+ public:
+  explicit SharedSubscription(std::string topic)
+      : sub(std::move(topic), INIT_AWAIT_NEW, ITER_NEXT, [this](Packet pkt) {
+          fanout_seq++;
+          for (auto* cb : *listeners.load()) {
+            (*cb)(pkt);
+          }
+          fanout_seq++;
+        }) {}
+
+  SharedSubscription(const SharedSubscription&) = delete;
+  SharedSubscription& operator=(const SharedSubscription&) = delete;
+
+  // Removes its callback on destruction, waiting for any call in progress.
+  // The last Handle on a topic also closes its Subscriber.
+  // Must not be destroyed from within its own callback.
+  class Handle {
+    std::string topic;
+    SharedSubscription* shared{nullptr};
+    std::unique_ptr<const Callback> cb;
+
+   public:
+    Handle() = default;
+    Handle(std::string topic_, SharedSubscription* shared_, std::unique_ptr<const Callback> cb_)
+        : topic{std::move(topic_)}, shared{shared_}, cb{std::move(cb_)} {}
+    Handle(Handle&& other)
+        : topic{std::move(other.topic)}, shared{std::exchange(other.shared, nullptr)}, cb{std::move(other.cb)} {}
+    Handle& operator=(Handle&& other) {
+      if (this != &other) {
+        reset();
+        topic = std::move(other.topic);
+        shared = std::exchange(other.shared, nullptr);
+        cb = std::move(other.cb);
+      }
+      return *this;
+    }
+    ~Handle() {
+      reset();
+    }
+
+    void reset() {
+      if (!shared) {
+        return;
+      }
+      std::unique_ptr<SharedSubscription> closing;
+      {
+        auto& r = registry();
+        std::unique_lock<std::mutex> lk{r.mtx};
+        if (!std::exchange(shared, nullptr)->remove(cb.get())) {
+          auto it = r.subs.find(topic);
+          closing = std::move(it->second);
+          r.subs.erase(it);
+        }
+      }
+      cb.reset();
+      // Stops the Subscriber, if this was the last Handle, outside the lock.
+      closing.reset();
+    }
+  };
+
+  static Handle subscribe(const std::string& topic, Callback cb) {
+    auto owned_cb = std::make_unique<const Callback>(std::move(cb));
+    auto& r = registry();
+    std::unique_lock<std::mutex> lk{r.mtx};
+    auto& slot = r.subs[topic];
+    if (!slot) {
+      try {
+        slot = start(r, topic);
+      } catch (...) {
+        r.subs.erase(topic);
+        throw;
+      }
+    }
+    slot->add(owned_cb.get());
+    return Handle(topic, slot.get(), std::move(owned_cb));
+  }
+
+  // Subscribers started from now on run with this scheduling. Should be set
+  // before any subscribe, from a thread with the process' default scheduling.
+  static void set_scheduling(const Scheduling& scheduling, OnScheduled onscheduled) {
+    auto& r = registry();
+    std::unique_lock<std::mutex> lk{r.mtx};
+    r.starter.reset();
+    r.onscheduled = std::move(onscheduled);
+    if (scheduling.empty()) {
+      return;
+    }
+    r.starter = std::make_unique<ThreadPool>(1);
+    r.starter->submit([&r, scheduling]() { r.effective = scheduling.apply(); });
+    r.starter->wait();
+  }
+
+  // Number of topics with an open Subscriber.
+  static size_t count() {
+    auto& r = registry();
+    std::unique_lock<std::mutex> lk{r.mtx};
+    return r.subs.size();
+  }
+
+ private:
+  // Called with the registry mutex held.
+  static std::unique_ptr<SharedSubscription> start(Registry& r, const std::string& topic) {
+    if (!r.starter) {
+      return std::make_unique<SharedSubscription>(topic);
+    }
+    std::unique_ptr<SharedSubscription> sub;
+    std::exception_ptr err;
+    r.starter->submit([&]() {
+      try {
+        sub = std::make_unique<SharedSubscription>(topic);
+      } catch (...) {
+        err = std::current_exception();
+      }
+    });
+    r.starter->wait();
+    if (err) {
+      std::rethrow_exception(err);
+    }
+    if (r.onscheduled) {
+      r.onscheduled(topic, r.effective);
+    }
+    return sub;
+  }
+};
+
+}  // namespace a0::logger
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace a0::logger {
+
+// Fixed size pool of worker threads.
+// Queued tasks are completed before the pool is destroyed.
+class ThreadPool {
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::condition_variable idle_cv;
+  std::deque<std::function<void()>> tasks;
+  size_t active{0};
+  bool running{true};
+  std::vector<std::thread> threads;
+
+  void run() {
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+      cv.wait(lk, [&]() { return !tasks.empty() || !running; });
+      if (tasks.empty()) {
+        return;
+      }
+      auto task = std::move(tasks.front());
+      tasks.pop_front();
+      active++;
+
+      lk.unlock();
+      task();
+      lk.lock();
+
+      active--;
+      if (tasks.empty() && !active) {
+        idle_cv.notify_all();
+      }
+    }
+  }
+
+ public:
+  static size_t default_size() {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  explicit ThreadPool(size_t size = default_size()) {
+    for (size_t i = 0; i < size; i++) {
+      threads.emplace_back([this]() { run(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      running = false;
+      cv.notify_all();
+    }
+    for (auto&& t : threads) {
+      t.join();
+    }
+  }
+
+  void submit(std::function<void()> task) {
+    std::unique_lock<std::mutex> lk(mtx);
+    tasks.push_back(std::move(task));
+    cv.notify_one();
+  }
+
+  // Blocks until all submitted tasks have completed.
+  void wait() {
+    std::unique_lock<std::mutex> lk(mtx);
+    idle_cv.wait(lk, [&]() { return tasks.empty() && !active; });
+  }
+};
+
+}  // namespace a0::logger
@@ -3,6 +3,7 @@
 #include <a0.h>
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
 #include <functional>
 #include <memory>
 
@@ -18,6 +19,9 @@ class Trigger final {
 
   struct Base {
     virtual ~Base() = default;
+    // True if notifications come from a thread shared with other rules,
+    // which doesn't take the rule's scheduling.
+    virtual bool shared_thread() const { return false; }
   };
 
   struct Listener {
@@ -70,6 +74,11 @@ class Trigger final {
       std::unique_lock<std::mutex> lk{mtx};
       listeners.push_back(l);
     }
+
+    void remove_listener(Listener* l) {
+      std::unique_lock<std::mutex> lk{mtx};
+      listeners.erase(std::remove(listeners.begin(), listeners.end(), l), listeners.end());
+    }
   };
 
   using Notify = std::function<void()>;
@@ -91,6 +100,8 @@ class Trigger final {
     base = registrar()->at(config.type)(config.args, [listener]() { listener->ontrigger(); });
   }
 
+  bool shared_thread() const { return base->shared_thread(); }
+
  private:
   std::unique_ptr<Base> base;
 };
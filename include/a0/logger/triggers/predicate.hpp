@@ -0,0 +1,60 @@
+#pragma once
+
+#include <a0.h>
+
+#include "a0/logger/predicate.hpp"
+#include "a0/logger/shared_subscription.hpp"
+#include "a0/logger/trigger.hpp"
+
+namespace a0::logger {
+
+// Fires on messages whose JSON payload matches a predicate.
+// In "edge" mode (default), fires when the predicate becomes true.
+// In "level" mode, fires on every message for which it is true.
+// Payloads that aren't valid JSON are ignored.
+class PredicateTrigger : public Trigger::Base {
+  Predicate predicate;
+  bool edge{true};
+  bool last{false};
+  SharedSubscription::Handle sub;
+
+  static std::string required(const nlohmann::json& args, const std::string& key) {
+    if (!args.count(key)) {
+      throw std::invalid_argument("PredicateTrigger] Missing " + key);
+    }
+    return args[key].get<std::string>();
+  }
+
+ public:
+  PredicateTrigger(nlohmann::json args, Trigger::Notify notify)
+      : predicate{required(args, "predicate")} {
+    auto topic = required(args, "topic");
+    if (args.count("mode")) {
+      auto mode = args["mode"].get<std::string>();
+      if (mode != "edge" && mode != "level") {
+        throw std::invalid_argument("PredicateTrigger] Unknown mode: " + mode + ". Known: edge, level");
+      }
+      edge = mode == "edge";
+    }
+
+    // Every message is evaluated, so edges aren't missed.
+    sub = SharedSubscription::subscribe(
+        topic,
+        [this, notify](Packet pkt) {
+          auto result = predicate.eval(pkt.payload());
+          if (!result) {
+            return;
+          }
+          if (*result && (!edge || !last)) {
+            notify();
+          }
+          last = *result;
+        });
+  }
+
+  bool shared_thread() const override { return true; }
+};
+
+REGISTER_TRIGGER(predicate, PredicateTrigger);
+
+}  // namespace a0::logger
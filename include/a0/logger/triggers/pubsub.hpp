@@ -2,12 +2,14 @@
 
 #include <a0.h>
 
+#include "a0/logger/shared_subscription.hpp"
 #include "a0/logger/trigger.hpp"
 
 namespace a0::logger {
 
 class PubsubTrigger : public Trigger::Base {
-  Subscriber sub;
+  // Policies triggered by the same topic share one Subscriber.
+  SharedSubscription::Handle sub;
 
  public:
   PubsubTrigger(nlohmann::json args, Trigger::Notify notify) {
@@ -15,11 +17,12 @@ class PubsubTrigger : public Trigger::Base {
       throw std::invalid_argument("PubsubTrigger] Missing topic");
     }
 
-    sub = Subscriber(
+    sub = SharedSubscription::subscribe(
         args["topic"].get<std::string>(),
-        ITER_NEWEST,
         [notify](Packet) { notify(); });
   }
+
+  bool shared_thread() const override { return true; }
 };
 
 REGISTER_TRIGGER(pubsub, PubsubTrigger);
@@ -0,0 +1,391 @@
+#include <a0.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "a0/logger/compact.hpp"
+
+// Capacity benchmark for the logger binary.
+//
+// Runs bin/log against a temporary A0_ROOT and savepath, drives it with N
+// publishers across M topics, then verifies the saved logfiles for
+// completeness and ordering.
+//
+// Usage:
+//   bin/log_loadgen [--log_bin bin/log] [--topics 10] [--publishers 10]
+//                   [--rate 100] [--payload fixed:1024] [--duration 10]
+//                   [--trigger_rate 0] [--encoding a0]
+//
+// --payload is one of fixed:<bytes>, uniform:<min>:<max>, or
+// lognormal:<median>:<sigma>.
+// With --trigger_rate, topics use a count policy triggered at that rate,
+// instead of save_all. Only ordering is then verified.
+
+namespace a0::logger {
+
+using clock = std::chrono::steady_clock;
+
+// How long the logger may take to come up.
+static constexpr std::chrono::seconds kStartupTimeout{10};
+
+struct LoadgenConfig {
+  std::string log_bin{"bin/log"};
+  int num_topics{10};
+  int num_publishers{10};
+  double rate{100};
+  std::string payload{"fixed:1024"};
+  double duration{10};
+  double trigger_rate{0};
+  std::string encoding{"a0"};
+};
+
+// Every payload starts with the publisher id and sequence number.
+struct PayloadHeader {
+  uint32_t publisher;
+  uint64_t seq;
+} __attribute__((packed));
+
+class PayloadSizes {
+  std::string kind;
+  double a{0};
+  double b{0};
+
+ public:
+  PayloadSizes(const std::string& spec) {
+    auto first = spec.find(':');
+    kind = spec.substr(0, first);
+    auto rest = spec.substr(first + 1);
+    auto second = rest.find(':');
+    a = std::stod(rest.substr(0, second));
+    if (second != std::string::npos) {
+      b = std::stod(rest.substr(second + 1));
+    }
+    if (kind != "fixed" && kind != "uniform" && kind != "lognormal") {
+      throw std::invalid_argument("Unknown payload distribution: " + kind);
+    }
+  }
+
+  size_t sample(std::mt19937_64& rng) {
+    double size = a;
+    if (kind == "uniform") {
+      size = std::uniform_real_distribution<double>(a, b)(rng);
+    } else if (kind == "lognormal") {
+      size = std::lognormal_distribution<double>(std::log(a), b)(rng);
+    }
+    return std::max(sizeof(PayloadHeader), size_t(size));
+  }
+};
+
+struct ProcSample {
+  double cpu_s;
+  uint64_t rss_bytes;
+};
+
+static inline ProcSample sample_proc(pid_t pid) {
+  ProcSample s{0, 0};
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string field;
+  // utime and stime are fields 14 and 15. rss, in pages, is field 24.
+  for (int i = 1; i <= 24 && stat >> field; i++) {
+    if (i == 14 || i == 15) {
+      s.cpu_s += std::stod(field) / sysconf(_SC_CLK_TCK);
+    } else if (i == 24) {
+      s.rss_bytes = std::stoull(field) * sysconf(_SC_PAGESIZE);
+    }
+  }
+  return s;
+}
+
+class Loadgen {
+  LoadgenConfig config;
+  std::filesystem::path root;
+  std::filesystem::path savepath;
+
+  std::atomic<bool> publishing{true};
+  std::vector<std::atomic<uint64_t>> published;
+  std::atomic<uint64_t> published_bytes{0};
+
+  std::string topic_of(int publisher) {
+    return "loadgen/topic_" + std::to_string(publisher % config.num_topics);
+  }
+
+  nlohmann::json logger_config() {
+    nlohmann::json policy = {{"type", "save_all"}};
+    if (config.trigger_rate > 0) {
+      policy = {
+          {"type", "count"},
+          {"args", {{"save_prev", 10}, {"save_next", 10}}},
+          {"triggers", {{{"type", "rate"}, {"args", {{"hz", config.trigger_rate}}}}}},
+      };
+    }
+    return {
+        {"savepath", savepath},
+        {"default_encoding", config.encoding},
+        {"rules", {{
+                      {"protocol", "pubsub"},
+                      {"topic", "loadgen/*"},
+                      {"policies", {policy}},
+                  }}},
+    };
+  }
+
+  void publish(int id) {
+    std::mt19937_64 rng(id);
+    PayloadSizes sizes(config.payload);
+    Publisher pub(topic_of(id));
+
+    auto period = std::chrono::nanoseconds(int64_t(1e9 / config.rate));
+    auto next = clock::now();
+    std::string payload;
+    for (uint64_t seq = 0; publishing; seq++) {
+      payload.assign(sizes.sample(rng), 'x');
+      PayloadHeader hdr{uint32_t(id), seq};
+      memcpy(&payload[0], &hdr, sizeof(hdr));
+      pub.pub(payload);
+      published[id]++;
+      published_bytes += payload.size();
+
+      next += period;
+      std::this_thread::sleep_until(next);
+    }
+  }
+
+ public:
+  Loadgen(LoadgenConfig config_)
+      : config{std::move(config_)}, published(config.num_publishers) {
+    char tmpl[] = "/dev/shm/log_loadgen_XXXXXX";
+    root = mkdtemp(tmpl);
+    savepath = root / "saved";
+    setenv("A0_ROOT", (root / "a0").c_str(), 1);
+    setenv("A0_TOPIC", "loadgen_log", 1);
+  }
+
+  ~Loadgen() {
+    std::error_code ec;
+    std::filesystem::remove_all(root, ec);
+  }
+
+  int run() {
+    Cfg(env::topic()).write(Packet(logger_config().dump()));
+
+    // Written by the stats subscriber thread.
+    std::atomic<uint64_t> reader_lost{0};
+    Subscriber stats_sub(std::string(env::topic()) + "/stats", ITER_NEWEST, [&](Packet pkt) {
+      auto j = nlohmann::json::parse(pkt.payload());
+      if (!j.count("topics")) {
+        return;
+      }
+      uint64_t lost = 0;
+      for (auto&& topic : j["topics"]) {
+        lost += topic["lost"].get<uint64_t>();
+      }
+      reader_lost = lost;
+    });
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      execl(config.log_bin.c_str(), config.log_bin.c_str(), nullptr);
+      perror("exec");
+      _exit(127);
+    }
+    // The logger takes its deadman once running. If it never does, don't hang.
+    try {
+      Deadman(env::topic()).wait_taken(TimeMono::now() + kStartupTimeout);
+    } catch (const std::exception& e) {
+      fprintf(stderr, "Logger did not start within %lds: %s\n", (long)kStartupTimeout.count(), e.what());
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+      return 1;
+    }
+
+    std::vector<std::thread> publishers;
+    for (int i = 0; i < config.num_publishers; i++) {
+      publishers.emplace_back([this, i]() { publish(i); });
+    }
+
+    auto start = clock::now();
+    auto end = start + std::chrono::nanoseconds(int64_t(config.duration * 1e9));
+    auto start_proc = sample_proc(pid);
+    uint64_t peak_rss = 0;
+    while (clock::now() < end) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(250));
+      peak_rss = std::max(peak_rss, sample_proc(pid).rss_bytes);
+    }
+    auto end_proc = sample_proc(pid);
+
+    publishing = false;
+    for (auto&& t : publishers) {
+      t.join();
+    }
+    std::chrono::duration<double> pub_elapsed = clock::now() - start;
+
+    // Let the logger catch up, then stop it.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto shutdown_start = clock::now();
+    kill(pid, SIGTERM);
+    int status;
+    waitpid(pid, &status, 0);
+    std::chrono::duration<double> shutdown_elapsed = clock::now() - shutdown_start;
+
+    uint64_t total_published = 0;
+    for (auto&& n : published) {
+      total_published += n;
+    }
+
+    // Verify.
+    std::vector<uint64_t> saved(config.num_publishers);
+    std::vector<int64_t> last_seq(config.num_publishers, -1);
+    uint64_t out_of_order = 0;
+    uint64_t malformed = 0;
+    std::map<std::string, std::vector<std::filesystem::path>> logfiles;
+    for (auto&& entry : std::filesystem::recursive_directory_iterator(savepath)) {
+      auto filename = std::string(entry.path().filename());
+      if (entry.is_regular_file() && filename.rfind(".", 0) != 0 && entry.path().extension() == ".a0") {
+        logfiles[filename.substr(0, filename.rfind('@'))].push_back(entry.path());
+      }
+    }
+    for (auto&& [_, paths] : logfiles) {
+      // Logfile names end in their start time, so they sort chronologically.
+      std::sort(paths.begin(), paths.end());
+      for (auto&& path : paths) {
+        CompactReaderSync reader{File(std::string(path))};
+        while (reader.can_read()) {
+          auto payload = reader.read().payload();
+          PayloadHeader hdr;
+          if (payload.size() < sizeof(hdr)) {
+            malformed++;
+            continue;
+          }
+          memcpy(&hdr, payload.data(), sizeof(hdr));
+          if (hdr.publisher >= saved.size()) {
+            malformed++;
+            continue;
+          }
+          saved[hdr.publisher]++;
+          if (int64_t(hdr.seq) <= last_seq[hdr.publisher]) {
+            out_of_order++;
+          }
+          last_seq[hdr.publisher] = hdr.seq;
+        }
+      }
+    }
+    uint64_t total_saved = 0;
+    for (auto n : saved) {
+      total_saved += n;
+    }
+
+    double cpu_s = end_proc.cpu_s - start_proc.cpu_s;
+    printf("publishers:        %d across %d topics at %.1f Hz, payload %s\n",
+           config.num_publishers, config.num_topics, config.rate, config.payload.c_str());
+    printf("published:         %lu pkts, %.0f pkt/s, %.2f MiB/s\n",
+           (unsigned long)total_published,
+           total_published / pub_elapsed.count(),
+           published_bytes / pub_elapsed.count() / (1 << 20));
+    printf("saved:             %lu pkts\n", (unsigned long)total_saved);
+    if (config.trigger_rate <= 0) {
+      printf("missing:           %lu pkts (%.3f%%)\n",
+             (unsigned long)(total_published - std::min(total_published, total_saved)),
+             total_published ? 100.0 * (total_published - std::min(total_published, total_saved)) / total_published : 0);
+    }
+    printf("out of order:      %lu\n", (unsigned long)out_of_order);
+    printf("malformed:         %lu\n", (unsigned long)malformed);
+    printf("evicted (logger):  %lu\n", (unsigned long)reader_lost.load());
+    printf("logger cpu:        %.1f%%\n", 100 * cpu_s / config.duration);
+    printf("logger peak rss:   %.1f MiB\n", peak_rss / double(1 << 20));
+    printf("logger shutdown:   %.2fs, exit %d\n", shutdown_elapsed.count(), WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+
+    bool ok = out_of_order == 0 && malformed == 0;
+    if (config.trigger_rate <= 0) {
+      ok &= total_saved == total_published;
+    }
+    return ok ? 0 : 1;
+  }
+};
+
+}  // namespace a0::logger
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s [--log_bin bin/log] [--topics M] [--publishers N] [--rate hz] [--payload fixed:<bytes>|uniform:<min>:<max>|lognormal:<median>:<sigma>] [--duration s] [--trigger_rate hz] [--encoding a0|compact]\n",
+          argv0);
+}
+
+int main(int argc, char** argv) {
+  a0::logger::LoadgenConfig config;
+
+  static struct option long_opts[] = {
+      {"log_bin", required_argument, 0, 'b'},
+      {"topics", required_argument, 0, 'm'},
+      {"publishers", required_argument, 0, 'n'},
+      {"rate", required_argument, 0, 'r'},
+      {"payload", required_argument, 0, 'p'},
+      {"duration", required_argument, 0, 'd'},
+      {"trigger_rate", required_argument, 0, 't'},
+      {"encoding", required_argument, 0, 'e'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, nullptr)) != -1) {
+    switch (opt) {
+      case 'b': {
+        config.log_bin = optarg;
+        break;
+      }
+      case 'm': {
+        config.num_topics = std::stoi(optarg);
+        break;
+      }
+      case 'n': {
+        config.num_publishers = std::stoi(optarg);
+        break;
+      }
+      case 'r': {
+        config.rate = std::stod(optarg);
+        break;
+      }
+      case 'p': {
+        config.payload = optarg;
+        break;
+      }
+      case 'd': {
+        config.duration = std::stod(optarg);
+        break;
+      }
+      case 't': {
+        config.trigger_rate = std::stod(optarg);
+        break;
+      }
+      case 'e': {
+        config.encoding = optarg;
+        break;
+      }
+      default: {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if (config.num_topics <= 0 || config.num_publishers <= 0 || config.rate <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  return a0::logger::Loadgen(config).run();
+}
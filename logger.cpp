@@ -2,17 +2,35 @@
 #include <signal.h>
 #include <unistd.h>
 
-#include <deque>
+#include <atomic>
+#include <charconv>
 #include <filesystem>
+#include <map>
+#include <optional>
 #include <unordered_set>
 #include <vector>
 
+#include "a0/logger/announcer.hpp"
+#include "a0/logger/block_checksums.hpp"
+#include "a0/logger/compact.hpp"
+#include "a0/logger/io_scheduler.hpp"
+#include "a0/logger/load_shedding.hpp"
+#include "a0/logger/migrator.hpp"
+#include "a0/logger/packet_pool.hpp"
+#include "a0/logger/packet_ring.hpp"
 #include "a0/logger/policies/count.hpp"
+#include "a0/logger/policies/decimate.hpp"
 #include "a0/logger/policies/drop_all.hpp"
+#include "a0/logger/policies/on_change.hpp"
 #include "a0/logger/policies/save_all.hpp"
 #include "a0/logger/policies/time.hpp"
+#include "a0/logger/pooled_reader.hpp"
 #include "a0/logger/rule.hpp"
+#include "a0/logger/scheduling.hpp"
+#include "a0/logger/shared_subscription.hpp"
+#include "a0/logger/thread_pool.hpp"
 #include "a0/logger/triggers/cron.hpp"
+#include "a0/logger/triggers/predicate.hpp"
 #include "a0/logger/triggers/pubsub.hpp"
 #include "a0/logger/triggers/rate.hpp"
 
@@ -21,23 +39,60 @@ namespace a0::logger {
 static const uint64_t kDefaultMaxLogfileSize = 128 * 1024 * 1024;
 static const std::chrono::nanoseconds kDefaultMaxLogfileDuration = std::chrono::hours(1);
 static const std::chrono::nanoseconds kDefaultStartupDelay = std::chrono::seconds(30);
+static const std::chrono::nanoseconds kDefaultStatsPeriod = std::chrono::seconds(1);
+static const std::chrono::nanoseconds kDefaultShutdownTimeout = std::chrono::seconds(8);
+static const uint64_t kDefaultPacketPoolSize = 16 * 1024 * 1024;
+static const uint64_t kDefaultIoMaxPending = 256 * 1024 * 1024;
 
 struct Config {
   std::filesystem::path searchpath;
   std::filesystem::path savepath;
+  std::filesystem::path staging_path;
+  uint64_t migrate_bandwidth;
   std::vector<Rule> rules;
   std::string trigger_control_topic;
   uint64_t default_max_logfile_size;
   std::chrono::nanoseconds default_max_logfile_duration;
+  std::string default_encoding;
   TimeMono start_time_mono;
+  std::chrono::nanoseconds stats_period;
+  std::optional<LoadShedder::Config> load_shedding;
+  std::chrono::nanoseconds shutdown_timeout;
+  Scheduling scheduling;
+  // Per FileLogger. Bytes of released packet buffers kept for reuse.
+  uint64_t packet_pool_size;
+  // Total write bandwidth shared by all FileLoggers. Zero means unlimited.
+  uint64_t io_budget;
+  // Per FileLogger. Past this many bytes waiting on io_budget, writes go out
+  // regardless, rather than hold more.
+  uint64_t io_max_pending;
+
+  nlohmann::json self_description;
+
+  // Settings other than the rules. If these change, every FileLogger is affected.
+  nlohmann::json globals() const {
+    auto j = self_description;
+    j.erase("rules");
+    j.erase("start_time_mono");
+    return j;
+  }
 };
 
 static inline void from_json(const nlohmann::json& j, Config& c) {
+  c.self_description = j;
+
   c.searchpath = env::root();
   if (j.count("searchpath")) {
     c.searchpath = j.at("searchpath").get<std::string>();
   }
   c.savepath = j.at("savepath").get<std::string>();
+  if (j.count("staging_path")) {
+    c.staging_path = j.at("staging_path").get<std::string>();
+  }
+  c.migrate_bandwidth = 0;
+  if (j.count("migrate_bandwidth")) {
+    c.migrate_bandwidth = parse_filesize(j.at("migrate_bandwidth"));
+  }
   j.at("rules").get_to(c.rules);
   if (j.count("trigger_control_topic")) {
     c.trigger_control_topic = j.at("trigger_control_topic");
@@ -51,10 +106,43 @@ static inline void from_json(const nlohmann::json& j, Config& c) {
   if (j.count("default_max_logfile_duration")) {
     c.default_max_logfile_duration = parse_duration(j.at("default_max_logfile_duration"));
   }
+  c.default_encoding = "a0";
+  if (j.count("default_encoding")) {
+    c.default_encoding = j.at("default_encoding");
+    if (c.default_encoding != "a0" && c.default_encoding != "compact") {
+      throw std::invalid_argument("Unknown encoding: " + c.default_encoding + ". Known: a0, compact");
+    }
+  }
   c.start_time_mono = TimeMono::now() - kDefaultStartupDelay;
   if (j.count("start_time_mono")) {
     c.start_time_mono = TimeMono::parse(j.at("start_time_mono"));
   }
+  c.stats_period = kDefaultStatsPeriod;
+  if (j.count("stats_period")) {
+    c.stats_period = parse_duration(j.at("stats_period"));
+  }
+  c.shutdown_timeout = kDefaultShutdownTimeout;
+  if (j.count("shutdown_timeout")) {
+    c.shutdown_timeout = parse_duration(j.at("shutdown_timeout"));
+  }
+  if (j.count("load_shedding")) {
+    c.load_shedding = j.at("load_shedding").get<LoadShedder::Config>();
+  }
+  if (j.count("scheduling")) {
+    j.at("scheduling").get_to(c.scheduling);
+  }
+  c.packet_pool_size = kDefaultPacketPoolSize;
+  if (j.count("packet_pool_size")) {
+    c.packet_pool_size = parse_filesize(j.at("packet_pool_size"));
+  }
+  c.io_budget = 0;
+  if (j.count("io_budget")) {
+    c.io_budget = parse_filesize(j.at("io_budget"));
+  }
+  c.io_max_pending = kDefaultIoMaxPending;
+  if (j.count("io_max_pending")) {
+    c.io_max_pending = parse_filesize(j.at("io_max_pending"));
+  }
 }
 
 static inline std::string_view env(std::string_view key,
@@ -63,32 +151,98 @@ static inline std::string_view env(std::string_view key,
   return val ? val : default_;
 }
 
-void announce(const nlohmann::json& j) {
-  static Publisher p(std::string(env::topic()) + "/announce");
+Announcer& announcer() {
+  static Announcer a(std::string(env::topic()) + "/announce");
+  return a;
+}
+
+void announce(nlohmann::json j) {
+  announcer().push([j = std::move(j)]() { return j; });
+}
+
+void report(const nlohmann::json& j) {
+  static Publisher p(std::string(env::topic()) + "/stats");
   p.pub(j.dump());
 }
 
 class FileLogger {
   const Config config;
   const Rule rule;
+  const std::shared_ptr<const nlohmann::json> rule_json;
+  const Scheduling scheduling;
+  Migrator* migrator;
+  IoScheduler* io_scheduler;
   std::mutex mtx;
 
-  std::deque<Packet> buffer;
+  // Packets awaiting a save decision. Shared by all policies.
+  PacketRing buffer;
   std::vector<std::unique_ptr<Policy>> policies;
 
+  std::filesystem::path write_root;
   std::filesystem::path write_progress_path;
   std::filesystem::path write_complete_path;
   File write_file;
   TimeMono write_file_start;
   Transport write_transport;
   Writer writer;
+  bool compact{false};
+  CompactEncoder encoder;
+  // Without a staging area, the checksum sidecar is built from the mapping as
+  // the logfile is written. With one, the Migrator builds it while copying.
+  std::optional<BlockChecksums::InPlace> write_checksums;
+  // Used space of write_transport after the last write.
+  uint64_t write_used{0};
+
+  // Saved packets waiting on the io_budget, in order, with their sizes.
+  std::shared_ptr<IoScheduler::Client> io_client;
+  bool io_limited{false};
+  std::deque<std::pair<Packet, int64_t>> pending_writes;
+  std::atomic<uint64_t> io_bypassed{0};
+
+  // Reader progress. Updated on the reader thread, sampled by the Logger.
+  std::atomic<uint64_t> num_received{0};
+  std::atomic<uint64_t> num_lost{0};
+  std::atomic<uint64_t> num_shed{0};
+  std::atomic<uint64_t> last_seq{0};
+  std::atomic<bool> has_seq{false};
+  std::atomic<bool> shedding{false};
+
+  // When the file was discovered, and how long until its first packet was
+  // buffered, or -1 until then.
+  const std::chrono::steady_clock::time_point discovered_at;
+  std::atomic<int64_t> first_packet_ns{-1};
+
+  bool drained{false};
+
+  // Timestamp of the last packet processed. Only read after the reader stops.
+  std::optional<TimeMono> last_mono;
 
   File read_file;
-  Reader reader;  // Must be defined last.
+  Transport read_transport;
+  std::shared_ptr<PacketPool> pool;
+  std::unique_ptr<PooledReader> reader;  // Must be defined last.
 
  public:
-  FileLogger(Config config_, Rule rule, File read_file)
-      : config{config_}, rule{rule}, read_file{read_file} {
+  // Reading starts with start_reading().
+  FileLogger(Config config_,
+             Rule rule,
+             File read_file,
+             Migrator* migrator,
+             IoScheduler* io_scheduler,
+             std::shared_ptr<PacketPool::Budget> pool_budget,
+             std::chrono::steady_clock::time_point discovered_at = std::chrono::steady_clock::now())
+      : config{config_},
+        rule{rule},
+        rule_json{std::make_shared<nlohmann::json>(rule.self_description)},
+        scheduling{rule.scheduling.over(config_.scheduling)},
+        migrator{migrator},
+        io_scheduler{io_scheduler},
+        discovered_at{discovered_at},
+        read_file{read_file} {
+    // With a staging area, files are written there and migrated once closed.
+    write_root = migrator ? config.staging_path : config.savepath;
+    compact = rule.encoding.value_or(config.default_encoding) == "compact";
+
     // Don't bother running if there are no policies.
     if (rule.policies.empty()) {
       return;
@@ -109,66 +263,284 @@ class FileLogger {
           policy_cfg, &mtx, extra_trigger_control_topics));
     }
 
-    // Start the reader. We'll look at all possible packets, and filter internally.
-    reader = Reader(read_file, INIT_OLDEST, [this](Packet pkt) {
-      // Drop packets without timestamps. This is likely from a raw Writer.
-      // TODO(lshamis): Let someone know?
-      if (!has_stamp(pkt)) {
-        return;
+    // Trigger threads start with the rule's scheduling already applied.
+    // Subscribers shared with other rules keep the global scheduling.
+    auto effective = start_threads([this]() {
+      for (auto&& policy : policies) {
+        policy->start_triggers();
       }
-      // Drop packets from old runs.
-      if (monotime_from(pkt) < config.start_time_mono) {
-        return;
-      }
-      // Process packet.
-      std::unique_lock<std::mutex> lk(mtx);
-      onpkt(pkt);
     });
+    size_t num_own = 0;
+    size_t num_shared = 0;
+    for (auto&& policy : policies) {
+      num_own += policy->num_triggers(false);
+      num_shared += policy->num_triggers(true);
+    }
+    if (effective && num_own) {
+      report_scheduling("trigger", *effective);
+    }
+    if (num_shared && !rule.scheduling.empty()) {
+      auto relpath = read_relpath();
+      fprintf(stderr,
+              "Warning: %s has its own scheduling, but its pubsub and predicate triggers run on shared threads, with the global scheduling.\n",
+              relpath.c_str());
+      announce({
+          {"action", "warning"},
+          {"details", "Rule scheduling does not apply to shared trigger threads. They use the global scheduling."},
+          {"read_relpath", relpath},
+          {"rule", *rule_json},
+      });
+    }
+
+    if (io_scheduler) {
+      io_client = io_scheduler->add(rule.io_weight, [this]() {
+        std::unique_lock<std::mutex> lk(mtx);
+        flush_pending_writes();
+      });
+      io_limited = true;
+    }
+
+    // Used to sample the newest sequence number in the arena.
+    read_transport = Transport(read_file);
+
+    // Packets return their buffers to the pool once dropped from the buffer.
+    pool = std::make_shared<PacketPool>(std::move(pool_budget));
+  }
+
+  // Starts the reader. We'll look at all possible packets, and filter internally.
+  void start_reading() {
+    if (rule.policies.empty()) {
+      return;
+    }
+    // The reader thread starts with the rule's scheduling already applied.
+    auto effective = start_threads([this]() {
+      reader = std::make_unique<PooledReader>(read_file, pool, [this](Packet pkt) {
+        track_seq(pkt);
+        // Low priority rules are skipped entirely while shedding load.
+        if (shedding) {
+          num_shed++;
+          return;
+        }
+        // Drop packets without timestamps. This is likely from a raw Writer.
+        // TODO(lshamis): Let someone know?
+        if (!has_stamp(pkt)) {
+          return;
+        }
+        // Drop packets from old runs.
+        auto mono = monotime_from(pkt);
+        if (mono < config.start_time_mono) {
+          return;
+        }
+        last_mono = mono;
+        if (first_packet_ns < 0) {
+          first_packet_ns = std::chrono::nanoseconds(std::chrono::steady_clock::now() - discovered_at).count();
+        }
+        // Process packet.
+        std::unique_lock<std::mutex> lk(mtx);
+        onpkt(pkt, mono_ns(mono));
+      });
+    });
+    if (effective) {
+      report_scheduling("reader", *effective);
+    }
   }
 
-  ~FileLogger() {
+  struct Stats {
+    uint64_t received;
+    uint64_t lost;
+    uint64_t shed;
+    uint64_t lag;
+    PacketPool::Stats pool;
+    int64_t io_pending;
+    uint64_t io_bypassed;
+    int64_t first_packet_ns;
+  };
+
+  Stats stats() {
+    Stats s;
+    s.received = num_received;
+    s.lost = num_lost;
+    s.shed = num_shed;
+    s.lag = 0;
+    if (has_seq) {
+      uint64_t newest = read_transport.lock().seq_high();
+      uint64_t last = last_seq;
+      s.lag = newest > last ? newest - last : 0;
+    }
+    s.pool = pool ? pool->stats() : PacketPool::Stats{};
+    s.io_pending = io_client ? io_client->pending_bytes() : 0;
+    s.io_bypassed = io_bypassed;
+    s.first_packet_ns = first_packet_ns;
+    return s;
+  }
+
+  const nlohmann::json& rule_description() const {
+    return rule.self_description;
+  }
+
+  // Stops reading new packets. Buffered packets are handled on destruction.
+  void stop_reading() {
+    reader.reset();
+  }
+
+  // Where a replacement FileLogger should pick up, if anything was read.
+  std::optional<TimeMono> resume_point() const {
+    return last_mono;
+  }
+
+  int priority() const {
+    return rule.priority;
+  }
+
+  bool is_shedding() const {
+    return shedding;
+  }
+
+  void set_shedding(bool shedding_) {
+    shedding = shedding_;
+  }
+
+  std::string read_relpath() const {
+    return std::filesystem::relative(read_file.path(), config.searchpath);
+  }
+
+  // Processes all remaining buffered packets and closes the file.
+  // Past the deadline, remaining packets are discarded and the file is closed
+  // at its current size. Returns false if the deadline was hit.
+  bool drain(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
     // Reader needs to be closed first to avoid modifying the buffer during cleanup.
-    reader = {};
+    stop_reading();
+    // From here on, writes ignore the io_budget.
+    if (io_client) {
+      io_scheduler->remove(io_client);
+    }
 
-    // Process all remaining buffered packets.
+    std::unique_lock<std::mutex> lk(mtx);
+    io_limited = false;
+    for (auto&& p : policies) {
+      p->consume_triggers();
+    }
+    bool complete = true;
+    while (!pending_writes.empty()) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        complete = false;
+        pending_writes.clear();
+        break;
+      }
+      commit(pending_writes.front().first);
+      pending_writes.pop_front();
+    }
     while (!buffer.empty()) {
-      auto pkt = buffer.front();
-      buffer.pop_front();
-
-      if (should_save(pkt) == SaveDecision::SAVE) {
-        maybe_start_next_file(pkt);
-        writer.write(pkt);
+      if (!complete || std::chrono::steady_clock::now() > deadline) {
+        complete = false;
+        buffer.clear();
+        break;
+      }
+      const auto& entry = buffer.front();
+      if (should_save(entry) == SaveDecision::SAVE) {
+        write(entry.pkt);
       }
       for (auto&& p : policies) {
-        p->ondrop(pkt);
+        p->ondrop(entry);
       }
+      buffer.pop_front();
     }
 
     // Truncate and close file.
     close_current_file();
+    drained = true;
+    return complete;
+  }
+
+  ~FileLogger() {
+    if (!drained) {
+      drain();
+    }
   }
 
  private:
+  // Called with mtx held. Formatting is deferred to the Announcer thread.
   void announce_action(std::string action, std::string details = "") {
+    announcer().push([action = std::move(action),
+                      details = std::move(details),
+                      write_abspath = write_complete_path,
+                      write_root = write_root,
+                      read_abspath = std::filesystem::path(read_file.path()),
+                      searchpath = config.searchpath,
+                      rule = rule_json]() -> nlohmann::json {
+      return {
+          {"action", action},
+          {"details", details},
+          {"write_abspath", write_abspath},
+          {"write_relpath", std::string(std::filesystem::relative(write_abspath, write_root))},
+          {"read_abspath", read_abspath},
+          {"read_relpath", std::string(std::filesystem::relative(read_abspath, searchpath))},
+          {"rule", *rule},
+      };
+    });
+  }
+
+  // Calls fn, which starts threads, such that they run with the rule's
+  // scheduling. Returns the settings they start with, if any are set.
+  std::optional<nlohmann::json> start_threads(const std::function<void()>& fn) {
+    if (scheduling.empty()) {
+      fn();
+      return std::nullopt;
+    }
+    return scheduling.start_threads(fn);
+  }
+
+  void report_scheduling(const char* thread, const nlohmann::json& effective) {
+    auto relpath = read_relpath();
+    fprintf(effective.count("errors") ? stderr : stdout,
+            "Scheduling %s thread for %s: %s\n",
+            thread,
+            relpath.c_str(),
+            effective.dump().c_str());
     announce({
-        {"action", std::move(action)},
-        {"details", std::move(details)},
-        {"write_abspath", write_complete_path},
-        {"write_relpath", std::string(std::filesystem::relative(write_complete_path, config.savepath))},
-        {"read_abspath", read_file.path()},
-        {"read_relpath", std::string(std::filesystem::relative(read_file.path(), config.searchpath))},
-        {"rule", rule.self_description},
+        {"action", "scheduled"},
+        {"thread", thread},
+        {"read_relpath", relpath},
+        {"effective", effective},
+        {"rule", *rule_json},
     });
   }
 
-  void onpkt(Packet pkt) {
-    // Let all policies know about the new packet.
+  // Detects packets evicted from the arena before the reader reached them,
+  // using the sequence number stamped by the transport.
+  void track_seq(Packet pkt) {
+    num_received++;
+    auto it = pkt.headers().find("a0_transport_seq");
+    if (it == pkt.headers().end()) {
+      return;
+    }
+    // Set by the writer, so it may not be a number. Then loss isn't counted.
+    uint64_t seq;
+    const auto& val = it->second;
+    auto [end, err] = std::from_chars(val.data(), val.data() + val.size(), seq);
+    if (err != std::errc() || end != val.data() + val.size()) {
+      return;
+    }
+    if (has_seq && seq > last_seq + 1) {
+      num_lost += seq - last_seq - 1;
+    }
+    last_seq = seq;
+    has_seq = true;
+  }
+
+  void onpkt(Packet pkt, int64_t pkt_mono_ns) {
+    // Apply triggers fired since the previous packet.
     for (auto&& p : policies) {
-      p->onpkt(pkt);
+      p->consume_triggers();
     }
 
     // Push the packet to the back of the buffer.
-    buffer.push_back(pkt);
+    const auto& entry = buffer.push(std::move(pkt), pkt_mono_ns);
+
+    // Let all policies know about the new packet.
+    for (auto&& p : policies) {
+      p->onpkt(entry);
+    }
 
     // Process the buffer packets from the front.
     // TODO(lshamis): The buffer is only processed when a packet is published.
@@ -176,8 +548,7 @@ class FileLogger {
     while (!buffer.empty()) {
       switch (should_save(buffer.front())) {
         case SaveDecision::SAVE: {
-          maybe_start_next_file(buffer.front());
-          writer.write(buffer.front());
+          write(buffer.front().pkt);
           [[fallthrough]];
         };
         case SaveDecision::DROP: {
@@ -194,13 +565,13 @@ class FileLogger {
     }
   }
 
-  SaveDecision should_save(Packet pkt) {
+  SaveDecision should_save(const PacketRing::Entry& entry) {
     // If any policy wants to save: SAVE.
     // If no policy wants to save, but might in the future: DEFER.
     // If all policies want to drop: DROP.
     SaveDecision sd = SaveDecision::DROP;
     for (auto&& p : policies) {
-      auto pd = p->should_save(pkt);
+      auto pd = p->should_save(entry);
       if (pd == SaveDecision::SAVE) {
         return SaveDecision::SAVE;
       } else if (pd == SaveDecision::DEFER) {
@@ -215,6 +586,12 @@ class FileLogger {
       // Resize file to used space.
       auto tlk = write_transport.lock();
       tlk.resize(tlk.used_space());
+      std::optional<BlockChecksums> checksums;
+      if (write_checksums) {
+        // Only the first block and the tail are left, still in memory.
+        checksums = write_checksums->finish(write_file.c->arena.buf.data, tlk.used_space());
+        write_checksums.reset();
+      }
       write_file = {};
 
       std::error_code ec;
@@ -224,24 +601,101 @@ class FileLogger {
         return;
       }
 
+      // The sidecar is saved before the logfile gets its complete name, so a
+      // closed logfile always has one.
+      auto sidecar = BlockChecksums::sidecar_path(write_complete_path);
+      if (checksums) {
+        try {
+          checksums->save(sidecar);
+        } catch (const std::exception& e) {
+          announce_action("error", std::string("Checksum failed: ") + e.what());
+        }
+      }
+
       std::filesystem::rename(write_progress_path, write_complete_path, ec);
       if (ec) {
         announce_action("error", ec.message());
+        if (checksums) {
+          std::filesystem::remove(sidecar, ec);
+        }
         return;
       }
 
       announce_action("closed");
+
+      // The Migrator writes the checksum sidecar as it copies.
+      if (migrator) {
+        migrator->enqueue(write_complete_path);
+      }
     }
     write_file = {};
   }
 
-  void maybe_start_next_file(Packet pkt) {
-    if (!write_file.c || write_would_exceed_size(pkt) || write_would_exceed_duration(pkt)) {
+  // Writes the packet now, or queues it behind earlier packets until the
+  // io_budget allows.
+  void write(Packet pkt) {
+    if (!io_limited) {
+      commit(pkt);
+      return;
+    }
+
+    a0_packet_stats_t pkt_stats;
+    a0_packet_stats(*pkt.c, &pkt_stats);
+    int64_t size = pkt_stats.serial_size;
+    if (pending_writes.empty() && io_client->try_consume(size)) {
+      commit(pkt);
+      return;
+    }
+
+    pending_writes.push_back({pkt, size});
+    io_client->add_pending(size);
+    if (uint64_t(io_client->pending_bytes()) > config.io_max_pending) {
+      // Don't hold more. Write it all, and repay the tokens later.
+      while (!pending_writes.empty()) {
+        auto [pending_pkt, pending_size] = pending_writes.front();
+        pending_writes.pop_front();
+        io_client->add_pending(-pending_size);
+        io_client->force_consume(pending_size);
+        io_bypassed += pending_size;
+        commit(pending_pkt);
+      }
+    }
+  }
+
+  // Called with mtx held, on the scheduler thread, as tokens arrive.
+  void flush_pending_writes() {
+    while (!pending_writes.empty()) {
+      auto [pkt, size] = pending_writes.front();
+      if (!io_client->try_consume(size)) {
+        return;
+      }
+      pending_writes.pop_front();
+      io_client->add_pending(-size);
+      commit(pkt);
+    }
+  }
+
+  void commit(Packet pkt) {
+    // The size check must use the packet as it will be written.
+    auto out = encode(pkt);
+    if (!write_file.c || write_would_exceed_size(out) || write_would_exceed_duration(pkt)) {
       start_next_file(pkt);
       announce_action("opened");
+      // Encoder state is per file.
+      out = encode(pkt);
+    }
+    writer.write(out);
+    if (write_checksums) {
+      // Linking this frame was the last change to the one before it.
+      write_checksums->update(write_file.c->arena.buf.data, write_used);
+      write_used = write_transport.lock().used_space();
     }
   }
 
+  Packet encode(Packet pkt) {
+    return compact ? encoder.encode(pkt) : pkt;
+  }
+
   bool write_would_exceed_size(Packet pkt) {
     a0_packet_stats_t pkt_stats;
     a0_packet_stats(*pkt.c, &pkt_stats);
@@ -291,7 +745,7 @@ class FileLogger {
     strftime(&date_str[0], 11, "%Y/%m/%d", &now_tm);
     date_str[10] = 0;
 
-    write_complete_path = config.savepath / std::string(date_str) / std::filesystem::relative(read_file.path(), config.searchpath);
+    write_complete_path = write_root / std::string(date_str) / std::filesystem::relative(read_file.path(), config.searchpath);
     write_complete_path.replace_filename(std::string(write_complete_path.filename()) + "@" + walltime.to_string() + ".a0");
 
     write_progress_path = write_complete_path;
@@ -309,39 +763,402 @@ class FileLogger {
     write_file_start = monotime_from(pkt);
     write_transport = Transport(write_file);
     writer = Writer(write_file);
+    encoder.reset();
+    if (!migrator) {
+      write_checksums.emplace();
+      write_used = 0;
+    }
   }
 };
 
 class Logger {
-  const Config config;
+  Config config;
+
+  std::unique_ptr<Migrator> migrator;
+  std::unique_ptr<IoScheduler> io_scheduler;
+  // Caps the packet buffers cached across all FileLoggers.
+  std::shared_ptr<PacketPool::Budget> pool_budget;
 
   std::mutex mtx;
   std::unordered_set<std::string> seen_filepath;
-  std::vector<std::unique_ptr<FileLogger>> file_loggers;
-  std::vector<Discovery> watchers;
+  std::map<std::string, std::unique_ptr<FileLogger>> file_loggers;
+  // Where to resume reading each file, if its FileLogger was replaced.
+  std::map<std::string, TimeMono> resume_points;
+  // Bumped whenever the rules change. FileLoggers built for an older
+  // generation are discarded instead of inserted.
+  uint64_t generation{0};
 
-  void maybe_create_file_logger(const std::string& filepath) {
+  std::optional<LoadShedder> shedder;
+  std::optional<int> shed_below;
+  std::condition_variable monitor_cv;
+  bool monitor_running{true};
+  std::thread monitor_thread;
+
+  std::mutex watchers_mtx;
+  std::map<std::string, Discovery> watchers;
+
+  bool is_shutdown{false};
+
+  // Builds FileLoggers outside mtx. Declared last, so queued builds complete
+  // before anything they touch is destroyed.
+  ThreadPool builders;
+
+  // Periodically reports reader progress and, if configured, sheds load.
+  void monitor() {
+    std::unique_lock<std::mutex> lk(mtx);
+    while (monitor_running) {
+      monitor_cv.wait_for(lk, config.stats_period);
+      if (!monitor_running) {
+        break;
+      }
+
+      nlohmann::json topics = nlohmann::json::array();
+      std::vector<LoadShedder::Sample> samples;
+      for (auto&& [_, fl] : file_loggers) {
+        auto stats = fl->stats();
+        topics.push_back({
+            {"read_relpath", fl->read_relpath()},
+            {"priority", fl->priority()},
+            {"received", stats.received},
+            {"lost", stats.lost},
+            {"shed", stats.shed},
+            {"lag", stats.lag},
+            {"shedding", fl->is_shedding()},
+            {"pool", {
+                         {"hits", stats.pool.hits},
+                         {"misses", stats.pool.misses},
+                         {"hit_rate", stats.pool.hits + stats.pool.misses ? double(stats.pool.hits) / (stats.pool.hits + stats.pool.misses) : 0.0},
+                         {"footprint", stats.pool.cached_bytes + stats.pool.outstanding_bytes},
+                     }},
+            {"io_pending", stats.io_pending},
+            {"io_bypassed", stats.io_bypassed},
+            {"first_packet_ms", stats.first_packet_ns < 0 ? nlohmann::json(nullptr) : nlohmann::json(stats.first_packet_ns / 1e6)},
+        });
+        samples.push_back({fl->priority(), stats.lag, fl->is_shedding()});
+      }
+      nlohmann::json summary = {
+          {"topics", std::move(topics)},
+          {"announce_dropped", announcer().dropped()},
+          {"trigger_subscribers", SharedSubscription::count()},
+      };
+      if (migrator) {
+        auto migrator_stats = migrator->stats();
+        summary["migrator"] = {
+            {"queued", migrator_stats.queued},
+            {"retrying", migrator_stats.retrying},
+        };
+      }
+      report(summary);
+
+      if (!shedder) {
+        continue;
+      }
+      auto next_shed_below = shedder->update(samples, std::chrono::steady_clock::now());
+      if (next_shed_below != shed_below) {
+        shed_below = next_shed_below;
+        announce({
+            {"action", "shedding"},
+            {"details", shed_below ? "priority < " + std::to_string(*shed_below) : "off"},
+        });
+      }
+      for (auto&& [_, fl] : file_loggers) {
+        fl->set_shedding(shed_below && fl->priority() < *shed_below);
+      }
+    }
+  }
+
+  // Rules are "first-match-wins".
+  const Rule* matching_rule(const std::string& filepath) {
     for (auto&& rule : config.rules) {
       auto path_glob = PathGlob(config.searchpath / rule.relative_watch_path());
       if (path_glob.match(filepath)) {
-        file_loggers.push_back(std::make_unique<FileLogger>(config, rule, File(filepath)));
+        return &rule;
+      }
+    }
+    return nullptr;
+  }
+
+  // Called with mtx held. Opening the file and starting policies and
+  // triggers is slow, so the FileLogger is built on the builders pool, and
+  // inserted once ready, unless the rules changed in the meantime.
+  void maybe_create_file_logger(const std::string& filepath) {
+    auto* rule = matching_rule(filepath);
+    if (!rule) {
+      return;
+    }
+
+    auto fl_config = config;
+    auto resume = resume_points.find(filepath);
+    if (resume != resume_points.end()) {
+      fl_config.start_time_mono = resume->second + std::chrono::nanoseconds(1);
+    }
+    builders.submit([this,
+                     filepath,
+                     fl_config = std::move(fl_config),
+                     rule = *rule,
+                     build_generation = generation,
+                     discovered_at = std::chrono::steady_clock::now()]() {
+      std::unique_ptr<FileLogger> fl;
+      try {
+        fl = std::make_unique<FileLogger>(fl_config, rule, File(filepath), migrator.get(), io_scheduler.get(), pool_budget, discovered_at);
+      } catch (const std::exception& e) {
+        announce({
+            {"action", "error"},
+            {"details", std::string("Failed to start logging: ") + e.what()},
+            {"read_abspath", filepath},
+        });
+        return;
+      }
+
+      std::unique_lock<std::mutex> lk(mtx);
+      if (build_generation != generation || file_loggers.count(filepath)) {
+        // Never started reading. Destroyed after lk is released.
         return;
       }
+      fl->start_reading();
+      file_loggers[filepath] = std::move(fl);
+    });
+  }
+
+  // Called with mtx held. Stops reading and records where to resume. The
+  // returned FileLogger still holds unwritten packets, and should be drained
+  // after mtx is released.
+  std::unique_ptr<FileLogger> remove_file_logger(const std::string& filepath) {
+    auto it = file_loggers.find(filepath);
+    auto fl = std::move(it->second);
+    file_loggers.erase(it);
+    fl->stop_reading();
+    auto resume = fl->resume_point();
+    if (resume) {
+      resume_points.insert_or_assign(filepath, *resume);
+    }
+    return fl;
+  }
+
+  // Watches each rule's path. Watchers for paths no longer in use are removed.
+  void update_watchers() {
+    std::unordered_set<std::string> watch_paths;
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      for (auto&& rule : config.rules) {
+        watch_paths.insert(config.searchpath / rule.relative_watch_path());
+      }
+    }
+
+    // Discovery callbacks take mtx, so watchers are never changed while holding it.
+    std::unique_lock<std::mutex> lk(watchers_mtx);
+    for (auto it = watchers.begin(); it != watchers.end();) {
+      if (watch_paths.count(it->first)) {
+        ++it;
+      } else {
+        it = watchers.erase(it);
+      }
+    }
+    for (auto&& watch_path : watch_paths) {
+      if (watchers.count(watch_path)) {
+        continue;
+      }
+      watchers.emplace(watch_path, Discovery(watch_path, [this](const std::string& filepath) {
+                         std::unique_lock<std::mutex> lk(mtx);
+                         if (seen_filepath.insert(filepath).second) {
+                           maybe_create_file_logger(filepath);
+                         }
+                       }));
     }
   }
 
  public:
-  Logger(Config config_)
-      : config{std::move(config_)} {
-    for (auto&& rule : config.rules) {
-      auto watch_path = config.searchpath / rule.relative_watch_path();
-      watchers.emplace_back(watch_path, [this](const std::string& filepath) {
-        std::unique_lock<std::mutex> lk(mtx);
-        if (seen_filepath.insert(filepath).second) {
-          maybe_create_file_logger(filepath);
+  Logger(Config config_, std::map<std::string, TimeMono> resume_points_ = {})
+      : config{std::move(config_)}, resume_points{std::move(resume_points_)} {
+    if (!config.staging_path.empty()) {
+      migrator = std::make_unique<Migrator>(
+          config.staging_path,
+          config.savepath,
+          config.migrate_bandwidth,
+          // Runs on the migrator thread. config may be replaced meanwhile.
+          [savepath = config.savepath](const std::filesystem::path& dst, const std::string& err) {
+            announce({
+                {"action", err.empty() ? "migrated" : "error"},
+                {"details", err},
+                {"write_abspath", dst},
+                {"write_relpath", std::string(std::filesystem::relative(dst, savepath))},
+            });
+          },
+          [](const std::filesystem::path& logfile) {
+            // As in close_current_file.
+            uint64_t used;
+            {
+              File file(logfile.string());
+              Transport transport(file);
+              auto tlk = transport.lock();
+              used = tlk.used_space();
+              tlk.resize(used);
+            }
+            std::filesystem::resize_file(logfile, used);
+          });
+    }
+
+    if (config.io_budget) {
+      io_scheduler = std::make_unique<IoScheduler>(config.io_budget);
+    }
+    pool_budget = std::make_shared<PacketPool::Budget>(config.packet_pool_size);
+
+    // Trigger subscribers are shared by all rules, so take the global settings.
+    SharedSubscription::set_scheduling(config.scheduling, [](const std::string& topic, const nlohmann::json& effective) {
+      fprintf(effective.count("errors") ? stderr : stdout,
+              "Scheduling trigger subscriber thread for %s: %s\n",
+              topic.c_str(),
+              effective.dump().c_str());
+      announce({
+          {"action", "scheduled"},
+          {"thread", "trigger_subscriber"},
+          {"topic", topic},
+          {"effective", effective},
+      });
+    });
+
+    update_watchers();
+
+    if (config.load_shedding) {
+      shedder.emplace(*config.load_shedding);
+    }
+    monitor_thread = std::thread([this]() { monitor(); });
+  }
+
+  ~Logger() {
+    shutdown();
+  }
+
+  // Stops all readers, then drains and closes every FileLogger in parallel.
+  // Work left at the shutdown_timeout is abandoned. Files are closed cleanly
+  // at their current size.
+  void shutdown() {
+    if (is_shutdown) {
+      return;
+    }
+    is_shutdown = true;
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto deadline = start + config.shutdown_timeout;
+    auto ms_since = [](clock::time_point t) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - t).count();
+    };
+
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      monitor_running = false;
+      monitor_cv.notify_all();
+    }
+    monitor_thread.join();
+
+    // Stop discovering new files before tearing down the FileLoggers.
+    {
+      std::unique_lock<std::mutex> lk(watchers_mtx);
+      watchers.clear();
+    }
+    builders.wait();
+
+    std::unique_lock<std::mutex> lk(mtx);
+    ThreadPool pool;
+
+    auto phase_start = clock::now();
+    for (auto&& [_, fl] : file_loggers) {
+      pool.submit([&fl = fl]() { fl->stop_reading(); });
+    }
+    pool.wait();
+    auto stop_ms = ms_since(phase_start);
+
+    phase_start = clock::now();
+    std::atomic<size_t> num_timed_out{0};
+    for (auto&& [_, fl] : file_loggers) {
+      pool.submit([&fl = fl, &num_timed_out, deadline]() {
+        if (!fl->drain(deadline)) {
+          num_timed_out++;
         }
+        fl.reset();
       });
     }
+    pool.wait();
+    auto num_file_loggers = file_loggers.size();
+    file_loggers.clear();
+    auto drain_ms = ms_since(phase_start);
+
+    phase_start = clock::now();
+    if (migrator) {
+      migrator->shutdown(deadline);
+    }
+    auto migrate_ms = ms_since(phase_start);
+
+    printf("Shutdown: stop readers %ldms, drain %ldms, migrate %ldms, total %ldms. %zu of %zu files hit the deadline.\n",
+           long(stop_ms), long(drain_ms), long(migrate_ms), long(ms_since(start)),
+           size_t(num_timed_out), num_file_loggers);
+    report({{"shutdown", {
+                             {"stop_readers_ms", stop_ms},
+                             {"drain_ms", drain_ms},
+                             {"migrate_ms", migrate_ms},
+                             {"total_ms", ms_since(start)},
+                             {"file_loggers", num_file_loggers},
+                             {"timed_out", size_t(num_timed_out)},
+                         }}});
+  }
+
+  // Applies new rules, only rebuilding the FileLoggers whose rule changed.
+  // Returns false if settings other than the rules changed. The caller must
+  // then replace the Logger, passing along resume_points().
+  bool reconfigure(Config next) {
+    std::vector<std::unique_ptr<FileLogger>> removed;
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      if (next.globals() != config.globals()) {
+        return false;
+      }
+      config = std::move(next);
+      generation++;
+
+      std::vector<std::string> stale;
+      for (auto&& [filepath, fl] : file_loggers) {
+        auto* rule = matching_rule(filepath);
+        if (!rule || rule->self_description != fl->rule_description()) {
+          stale.push_back(filepath);
+        }
+      }
+      for (auto&& filepath : stale) {
+        removed.push_back(remove_file_logger(filepath));
+      }
+
+      // Also picks up files that previously had no matching rule, and
+      // rebuilds any discarded above for the older generation.
+      for (auto&& filepath : seen_filepath) {
+        if (!file_loggers.count(filepath)) {
+          maybe_create_file_logger(filepath);
+        }
+      }
+    }
+
+    update_watchers();
+
+    // Draining may wait on the io_budget, so it's done outside mtx, where it
+    // doesn't hold up discovery, stats, or the replacement FileLoggers.
+    ThreadPool pool;
+    for (auto&& fl : removed) {
+      pool.submit([&fl = fl]() { fl.reset(); });
+    }
+    pool.wait();
+    return true;
+  }
+
+  std::map<std::string, TimeMono> stop_and_get_resume_points() {
+    builders.wait();
+    std::unique_lock<std::mutex> lk(mtx);
+    for (auto&& [filepath, fl] : file_loggers) {
+      fl->stop_reading();
+      auto resume = fl->resume_point();
+      if (resume) {
+        resume_points.insert_or_assign(filepath, *resume);
+      }
+    }
+    return resume_points;
   }
 };
 
@@ -349,8 +1166,34 @@ class Logger {
 
 int main() {
   a0::Cfg cfg(a0::env::topic());
-  auto config = cfg.var<a0::logger::Config>("");
-  a0::logger::Logger logger(*config);
+  a0::logger::Config config = *cfg.var<a0::logger::Config>("");
+
+  std::mutex logger_mtx;
+  auto logger = std::make_unique<a0::logger::Logger>(config);
+
+  // Apply config updates without restarting.
+  a0::CfgWatcher cfg_watcher(a0::env::topic(), [&](a0::Packet pkt) {
+    a0::logger::Config next;
+    try {
+      next = nlohmann::json::parse(pkt.payload());
+    } catch (const std::exception& e) {
+      a0::logger::announce({{"action", "error"}, {"details", std::string("Invalid config: ") + e.what()}});
+      return;
+    }
+
+    std::unique_lock<std::mutex> lk(logger_mtx);
+    if (next.self_description == config.self_description) {
+      return;
+    }
+    config = next;
+    if (!logger->reconfigure(next)) {
+      // Global settings changed. Rebuild everything, without re-saving packets.
+      auto resume_points = logger->stop_and_get_resume_points();
+      logger.reset();
+      logger = std::make_unique<a0::logger::Logger>(next, std::move(resume_points));
+    }
+    a0::logger::announce({{"action", "reconfigured"}});
+  });
 
   a0::Deadman deadman(a0::env::topic());
   deadman.take();
@@ -366,4 +1209,7 @@ int main() {
   int signo;
   sigwait(&sigset, &signo);
   printf("Caught signal %d. Shutting down...\n", signo);
+
+  cfg_watcher = {};
+  logger.reset();
 }
@@ -0,0 +1,428 @@
+#include <a0.h>
+#include <fnmatch.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "a0/logger/compact.hpp"
+
+// Replays saved logfiles onto live topics, in a0_time_wall order.
+//
+// Usage:
+//   bin/log_replay --savepath /nfs/logs [--topic 'camera_*'] ...
+//                  [--start <wall>] [--end <wall>] [--speed 1|<N>|max]
+//                  [--dest <root>]
+//
+// Logfiles are found under savepath/YYYY/MM/DD/<relpath>@<wall>.a0, named
+// for the wall time of their first packet. --start and --end select which
+// day directories are searched and which logfiles are opened, then filter
+// packets by their a0_time_wall. Wall time is used, rather than
+// a0_time_mono, as mono time restarts with each boot.
+// --topic globs match against <relpath>, ex. foo.pubsub.a0, and may be given
+// multiple times. By default, all logfiles are replayed.
+// Logfiles are opened only once the replay reaches them, and closed once
+// done.
+// Packets are written, with their original headers, into <dest>/<relpath>.
+// dest defaults to A0_ROOT.
+
+namespace a0::logger {
+
+using clock = std::chrono::steady_clock;
+
+struct ReplayConfig {
+  std::filesystem::path savepath;
+  std::filesystem::path dest;
+  std::vector<std::string> topics;
+  // Wall time, in nanoseconds since the epoch.
+  std::optional<int64_t> start_ns;
+  std::optional<int64_t> end_ns;
+  // Zero means as fast as possible.
+  double speed{1};
+};
+
+static inline int64_t wall_ns(const std::string& str) {
+  auto ts = TimeWall::parse(str).c->ts;
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static inline int64_t wall_ns(Packet pkt) {
+  auto it = pkt.headers().find("a0_time_wall");
+  if (it == pkt.headers().end()) {
+    return -1;
+  }
+  return wall_ns(it->second);
+}
+
+// The UTC day directory, YYYY/MM/DD, of logfiles begun at the wall time.
+static inline std::string day_of(int64_t ns) {
+  time_t sec = ns / 1000000000;
+  struct tm tm;
+  gmtime_r(&sec, &tm);
+  char str[11];
+  strftime(str, sizeof(str), "%Y/%m/%d", &tm);
+  return str;
+}
+
+// The logfile's path, relative to the searchpath it was read from.
+static inline std::string relpath_of(const std::filesystem::path& savepath,
+                                     const std::filesystem::path& logfile) {
+  // Strip YYYY/MM/DD.
+  auto rel = std::filesystem::relative(logfile, savepath);
+  std::filesystem::path out;
+  int depth = 0;
+  for (auto&& part : rel) {
+    if (depth++ >= 3) {
+      out /= part;
+    }
+  }
+  // Strip @<timestamp>.a0.
+  auto str = std::string(out);
+  return str.substr(0, str.rfind('@'));
+}
+
+class Replay {
+  // A logfile found under savepath, opened once the replay reaches it.
+  struct Logfile {
+    std::filesystem::path path;
+    std::string relpath;
+    // Wall time of its first packet, from its filename.
+    int64_t start_ns;
+  };
+
+  struct Source {
+    CompactReaderSync reader;
+    Writer* writer;
+    Packet next;
+    int64_t next_ns;
+  };
+
+  struct HeapEntry {
+    int64_t ns;
+    size_t idx;
+    bool operator>(const HeapEntry& other) const {
+      return ns > other.ns;
+    }
+  };
+
+  // Logfiles begun up to this long before --start are searched, for packets
+  // in range.
+  static constexpr int64_t kLookbackNs = 24 * 60 * 60 * int64_t(1000000000);
+
+  ReplayConfig config;
+  std::map<std::string, Writer> writers;
+  // In order of start_ns.
+  std::vector<Logfile> logfiles;
+  size_t next_logfile{0};
+  // Open logfiles. Closed, and reset, once exhausted.
+  std::vector<std::unique_ptr<Source>> sources;
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+
+  bool topic_match(const std::string& relpath) {
+    if (config.topics.empty()) {
+      return true;
+    }
+    for (auto&& glob : config.topics) {
+      if (fnmatch(glob.c_str(), relpath.c_str(), 0) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether a directory, at the given prefix of YYYY/MM/DD, may hold
+  // logfiles begun in the range.
+  bool day_match(const std::string& prefix) {
+    auto len = prefix.size();
+    if (config.start_ns && prefix < day_of(*config.start_ns - kLookbackNs).substr(0, len)) {
+      return false;
+    }
+    if (config.end_ns && prefix > day_of(*config.end_ns).substr(0, len)) {
+      return false;
+    }
+    return true;
+  }
+
+  static std::vector<std::filesystem::path> subdirs(const std::filesystem::path& dir) {
+    std::vector<std::filesystem::path> out;
+    for (auto&& entry : std::filesystem::directory_iterator(dir)) {
+      if (entry.is_directory()) {
+        out.push_back(entry.path());
+      }
+    }
+    return out;
+  }
+
+  void find_logfiles() {
+    std::map<std::string, std::vector<Logfile>> by_topic;
+    for (auto&& year : subdirs(config.savepath)) {
+      auto y = std::string(year.filename());
+      if (!day_match(y)) {
+        continue;
+      }
+      for (auto&& month : subdirs(year)) {
+        auto ym = y + "/" + std::string(month.filename());
+        if (!day_match(ym)) {
+          continue;
+        }
+        for (auto&& day : subdirs(month)) {
+          if (!day_match(ym + "/" + std::string(day.filename()))) {
+            continue;
+          }
+          for (auto&& entry : std::filesystem::recursive_directory_iterator(day)) {
+            auto filename = std::string(entry.path().filename());
+            auto at = filename.rfind('@');
+            if (!entry.is_regular_file() || filename.rfind(".", 0) == 0 || entry.path().extension() != ".a0" || at == std::string::npos) {
+              continue;
+            }
+            auto relpath = relpath_of(config.savepath, entry.path());
+            if (!topic_match(relpath)) {
+              continue;
+            }
+            int64_t start_ns;
+            try {
+              start_ns = wall_ns(filename.substr(at + 1, filename.size() - at - 1 - 3));
+            } catch (const std::exception&) {
+              fprintf(stderr, "Skipping %s: no timestamp in its name.\n", entry.path().c_str());
+              continue;
+            }
+            by_topic[relpath].push_back({entry.path(), relpath, start_ns});
+          }
+        }
+      }
+    }
+
+    // A topic's logfiles follow one another. Of those begun before --start,
+    // only the last may hold packets in range.
+    size_t num_topics = 0;
+    for (auto&& [_, files] : by_topic) {
+      auto num_logfiles = logfiles.size();
+      std::sort(files.begin(), files.end(), [](const Logfile& a, const Logfile& b) { return a.start_ns < b.start_ns; });
+      for (size_t i = 0; i < files.size(); i++) {
+        if (config.end_ns && files[i].start_ns > *config.end_ns) {
+          break;
+        }
+        if (config.start_ns && i + 1 < files.size() && files[i + 1].start_ns <= *config.start_ns) {
+          continue;
+        }
+        logfiles.push_back(std::move(files[i]));
+      }
+      num_topics += logfiles.size() > num_logfiles;
+    }
+    std::sort(logfiles.begin(), logfiles.end(), [](const Logfile& a, const Logfile& b) { return a.start_ns < b.start_ns; });
+    fprintf(stderr, "Replaying %zu logfiles onto %zu topics.\n", logfiles.size(), num_topics);
+  }
+
+  // Opens the logfiles that may hold packets before the next one to replay.
+  void open_due() {
+    while (next_logfile < logfiles.size() && (heap.empty() || logfiles[next_logfile].start_ns <= heap.top().ns)) {
+      auto& logfile = logfiles[next_logfile++];
+      auto writer = writers.find(logfile.relpath);
+      if (writer == writers.end()) {
+        writer = writers.emplace(logfile.relpath, Writer(File(std::string(config.dest / logfile.relpath)))).first;
+      }
+      sources.push_back(std::unique_ptr<Source>(new Source{
+          CompactReaderSync(File(std::string(logfile.path))),
+          &writer->second,
+          Packet(),
+          0,
+      }));
+      if (advance(sources.back().get())) {
+        heap.push({sources.back()->next_ns, sources.size() - 1});
+      } else {
+        sources.back().reset();
+      }
+    }
+  }
+
+  // Reads the source's next packet within the time range.
+  // Returns false once the source is exhausted.
+  bool advance(Source* src) {
+    while (src->reader.can_read()) {
+      src->next = src->reader.read();
+      src->next_ns = wall_ns(src->next);
+      if (src->next_ns < 0 || (config.start_ns && src->next_ns < *config.start_ns)) {
+        continue;
+      }
+      if (config.end_ns && src->next_ns > *config.end_ns) {
+        return false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+ public:
+  Replay(ReplayConfig config_)
+      : config{std::move(config_)} {
+    find_logfiles();
+  }
+
+  void run() {
+    open_due();
+    if (heap.empty()) {
+      return;
+    }
+
+    const int64_t first_ns = heap.top().ns;
+    const auto start = clock::now();
+    auto last_report = start;
+
+    uint64_t num_pkts = 0;
+    uint64_t num_bytes = 0;
+    int64_t max_lag_ns = 0;
+    double sum_lag_ns = 0;
+
+    // Sleep until just before the deadline, then spin for accuracy.
+    static const auto kSpin = std::chrono::microseconds(200);
+
+    while (true) {
+      open_due();
+      if (heap.empty()) {
+        break;
+      }
+      auto [ns, idx] = heap.top();
+      heap.pop();
+      auto* src = sources[idx].get();
+
+      if (config.speed > 0) {
+        auto target = start + std::chrono::nanoseconds(int64_t((ns - first_ns) / config.speed));
+        if (clock::now() < target - kSpin) {
+          std::this_thread::sleep_until(target - kSpin);
+        }
+        while (clock::now() < target) {
+        }
+        auto lag_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - target).count();
+        max_lag_ns = std::max(max_lag_ns, lag_ns);
+        sum_lag_ns += lag_ns;
+      }
+
+      src->writer->write(src->next);
+      num_pkts++;
+      num_bytes += src->next.payload().size();
+
+      if (advance(src)) {
+        heap.push({src->next_ns, idx});
+      } else {
+        sources[idx].reset();
+      }
+
+      auto now = clock::now();
+      bool done = heap.empty() && next_logfile == logfiles.size();
+      if (now - last_report > std::chrono::seconds(1) || done) {
+        last_report = now;
+        std::chrono::duration<double> elapsed = now - start;
+        double replayed_s = (ns - first_ns) / 1e9;
+        fprintf(stderr,
+                "%.1fs elapsed, %.1fs of log replayed (%.2fx): %lu pkts, %.0f pkt/s, %.1f MiB/s, lag avg %.1fus max %.1fus\n",
+                elapsed.count(),
+                replayed_s,
+                elapsed.count() ? replayed_s / elapsed.count() : 0,
+                (unsigned long)num_pkts,
+                elapsed.count() ? num_pkts / elapsed.count() : 0,
+                elapsed.count() ? num_bytes / elapsed.count() / (1 << 20) : 0,
+                num_pkts ? sum_lag_ns / num_pkts / 1e3 : 0,
+                max_lag_ns / 1e3);
+      }
+    }
+  }
+};
+
+}  // namespace a0::logger
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "Usage: %s --savepath <dir> [--topic <glob>]... [--start <wall>] [--end <wall>] [--speed 1|<N>|max] [--dest <root>]\n",
+          argv0);
+}
+
+// Prints what's expected, rather than letting a bad time escape main.
+static std::optional<int64_t> parse_wall_arg(const char* argv0, const char* flag, const char* arg) {
+  try {
+    return a0::logger::wall_ns(arg);
+  } catch (const std::exception&) {
+    fprintf(stderr, "Invalid %s: %s\nExpected a wall time, like 2021-10-19T21:43:52.866409862-00:00\n", flag, arg);
+    usage(argv0);
+    return std::nullopt;
+  }
+}
+
+int main(int argc, char** argv) {
+  a0::logger::ReplayConfig config;
+  config.dest = std::string(a0::env::root());
+
+  static struct option long_opts[] = {
+      {"savepath", required_argument, 0, 'p'},
+      {"topic", required_argument, 0, 't'},
+      {"start", required_argument, 0, 's'},
+      {"end", required_argument, 0, 'e'},
+      {"speed", required_argument, 0, 'x'},
+      {"dest", required_argument, 0, 'd'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, nullptr)) != -1) {
+    switch (opt) {
+      case 'p': {
+        config.savepath = optarg;
+        break;
+      }
+      case 't': {
+        config.topics.push_back(optarg);
+        break;
+      }
+      case 's': {
+        config.start_ns = parse_wall_arg(argv[0], "--start", optarg);
+        if (!config.start_ns) {
+          return 1;
+        }
+        break;
+      }
+      case 'e': {
+        config.end_ns = parse_wall_arg(argv[0], "--end", optarg);
+        if (!config.end_ns) {
+          return 1;
+        }
+        break;
+      }
+      case 'x': {
+        try {
+          config.speed = std::string(optarg) == "max" ? 0 : std::stod(optarg);
+        } catch (const std::exception&) {
+          config.speed = -1;
+        }
+        if (config.speed < 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      }
+      case 'd': {
+        config.dest = optarg;
+        break;
+      }
+      default: {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if (config.savepath.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  a0::logger::Replay(config).run();
+}
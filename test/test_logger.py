@@ -8,6 +8,7 @@ import pytest
 import re
 import subprocess
 import tempfile
+import threading
 import time
 
 # TODO(lshamis): Things to test:
@@ -61,6 +62,12 @@ class RunLogger:
             assert self.logger_proc.wait(3) == 0
             self.logger_proc = None
 
+    def kill(self):
+        # Simulates a crash. Nothing is cleaned up.
+        self.logger_proc.kill()
+        self.logger_proc.wait()
+        self.logger_proc = None
+
     def logged_packets(self):
         now = datetime.datetime.utcnow()
         # Want something like:
@@ -249,8 +256,9 @@ def test_policy_time(sandbox):
     }
 
 
-def test_trigger_rate(sandbox):
+def test_policy_decimate(sandbox):
     foo = a0.Publisher("foo")
+    trigger_control = a0.Publisher("trigger_control")
 
     sandbox.start({
         "savepath":
@@ -260,35 +268,42 @@ def test_trigger_rate(sandbox):
                 "pubsub",
             "topic":
                 "foo",
+            "trigger_control_topic":
+                "trigger_control",
             "policies": [{
-                "type": "count",
+                "type": "decimate",
                 "args": {
-                    "save_next": 1,
+                    "every_nth": 5,
+                    "full_rate_on_resume": True,
                 },
-                "triggers": [{
-                    "type": "rate",
-                    "args": {
-                        "hz": 2,
-                    },
-                }],
             }],
         }],
     })
 
     for i in range(20):
         foo.pub(f"foo_{i}")
-        time.sleep(0.25)
+    time.sleep(0.5)
+
+    trigger_control.pub("on")
+    time.sleep(0.5)
 
+    for i in range(20, 23):
+        foo.pub(f"foo_{i}")
     time.sleep(0.5)
 
     sandbox.shutdown()
 
-    assert 9 <= len(sandbox.logged_packets()["foo"]) <= 11
+    assert sandbox.logged_packets() == {
+        "foo": [
+            "foo_0", "foo_5", "foo_10", "foo_15", "foo_20", "foo_21", "foo_22"
+        ]
+    }
 
 
-def test_trigger_cron(sandbox):
+def test_policy_decimate_no_control(sandbox):
     foo = a0.Publisher("foo")
 
+    # Without a control topic, nothing ever resumes, so the rate stays reduced.
     sandbox.start({
         "savepath":
             sandbox.savepath.name,
@@ -298,186 +313,167 @@ def test_trigger_cron(sandbox):
             "topic":
                 "foo",
             "policies": [{
-                "type":
-                    "count",
+                "type": "decimate",
                 "args": {
-                    "save_next": 1,
+                    "every_nth": 5,
+                    "full_rate_on_resume": True,
                 },
-                "triggers": [{
-                    "type": "cron",
-                    "args": {
-                        "pattern": "*/2 * * * * *",
-                    },
-                }],
             }],
         }],
     })
 
     for i in range(20):
         foo.pub(f"foo_{i}")
-        time.sleep(0.25)
-
     time.sleep(0.5)
 
     sandbox.shutdown()
 
-    assert len(sandbox.logged_packets()["foo"]) in [3, 4]
+    assert sandbox.logged_packets() == {
+        "foo": ["foo_0", "foo_5", "foo_10", "foo_15"]
+    }
 
 
-def test_max_logfile_size(sandbox):
+def test_policy_decimate_large_payloads(sandbox):
     foo = a0.Publisher("foo")
-    bar = a0.Publisher("bar")
 
     sandbox.start({
         "savepath":
             sandbox.savepath.name,
-        "default_max_logfile_size":
-            "2MiB",
-        "rules": [
-            {
-                "protocol": "pubsub",
-                "topic": "foo",
-                "policies": [{
-                    "type": "save_all"
-                }],
-            },
-            {
-                "protocol": "pubsub",
-                "topic": "bar",
-                "max_logfile_size": "4MiB",
-                "policies": [{
-                    "type": "save_all"
-                }],
-            },
-        ],
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "policies": [{
+                "type": "decimate",
+                "args": {
+                    "bytes_per_sec": "1KiB",
+                },
+            }],
+        }],
     })
 
-    announcements = []
+    # Each payload is over the budget, so about one is saved per 2s.
+    msg = "a" * 2048
+    for i in range(30):
+        foo.pub(f"{i}_{msg}")
+        time.sleep(0.1)
+    time.sleep(0.5)
 
-    def on_announce(pkt):
-        announcements.append(json.loads(pkt.payload.decode()))
+    sandbox.shutdown()
 
-    s = a0.Subscriber(  # noqa:F841
-        "test/announce", a0.INIT_OLDEST, on_announce)
+    saved = sandbox.logged_packets()["foo"]
+    assert saved[0] == f"0_{msg}"
+    assert 2 <= len(saved) <= 3
 
-    msg = "a" * (1024 * 1024 // 2 - 1024)  # Half a megabyte minus epsilon.
-    for _ in range(16):
-        foo.pub(msg)
-        bar.pub(msg)
 
-    time.sleep(1)
+def test_policy_on_change(sandbox):
+    foo = a0.Publisher("foo")
 
-    sandbox.shutdown()
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "policies": [{
+                "type": "on_change",
+                "args": {
+                    "keyframe_every": 4,
+                },
+            }],
+        }],
+    })
 
-    topic_counter = {"foo.pubsub.a0": 0, "bar.pubsub.a0": 0}
-    for announcement in announcements:
-        assert announcement["action"] in ["opened", "closed"]
-        assert announcement["read_relpath"] in [
-            "foo.pubsub.a0", "bar.pubsub.a0"
-        ]
-        assert (announcement["read_abspath"] ==
-                f"{os.environ['A0_ROOT']}/{announcement['read_relpath']}")
-        assert announcement["write_relpath"] == pytest_regex(
-            f"\\d{{4}}/\\d{{2}}/\\d{{2}}/{announcement['read_relpath']}@\\d{{4}}-\\d{{2}}-\\d{{2}}T\\d{{2}}:\\d{{2}}:\\d{{2}}.\\d{{9}}-\\d{{2}}:\\d{{2}}.a0"  # noqa: E501
-        )
-        assert announcement["write_abspath"] == pytest_regex(
-            f"{sandbox.savepath.name}/{announcement['write_relpath']}")
-        topic_counter[announcement["read_relpath"]] += 1
+    for msg in ["a", "a", "b", "b", "b", "b", "b", "c", "a"]:
+        foo.pub(msg)
+    time.sleep(0.5)
 
-    assert topic_counter == {"foo.pubsub.a0": 8, "bar.pubsub.a0": 4}
+    sandbox.shutdown()
 
+    assert sandbox.logged_packets() == {"foo": ["a", "b", "b", "c", "a"]}
 
-def test_max_logfile_duration(sandbox):
+
+def test_trigger_rate(sandbox):
     foo = a0.Publisher("foo")
-    bar = a0.Publisher("bar")
 
     sandbox.start({
         "savepath":
             sandbox.savepath.name,
-        "default_max_logfile_duration":
-            "2s",
-        "rules": [
-            {
-                "protocol": "pubsub",
-                "topic": "foo",
-                "policies": [{
-                    "type": "save_all"
-                }],
-            },
-            {
-                "protocol": "pubsub",
-                "topic": "bar",
-                "max_logfile_duration": "4s",
-                "policies": [{
-                    "type": "save_all"
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "policies": [{
+                "type": "count",
+                "args": {
+                    "save_next": 1,
+                },
+                "triggers": [{
+                    "type": "rate",
+                    "args": {
+                        "hz": 2,
+                    },
                 }],
-            },
-        ],
+            }],
+        }],
     })
 
-    announcements = []
-
-    def on_announce(pkt):
-        announcements.append(json.loads(pkt.payload.decode()))
-
-    s = a0.Subscriber(  # noqa: F841
-        "test/announce", a0.INIT_OLDEST, on_announce)
+    for i in range(20):
+        foo.pub(f"foo_{i}")
+        time.sleep(0.25)
 
-    msg = "msg"
-    for _ in range(10):
-        foo.pub(msg)
-        bar.pub(msg)
-        time.sleep(0.5)
+    time.sleep(0.5)
 
     sandbox.shutdown()
 
-    topic_counter = {"foo.pubsub.a0": 0, "bar.pubsub.a0": 0}
-    for announcement in announcements:
-        assert announcement["action"] in ["opened", "closed"]
-        assert announcement["read_relpath"] in [
-            "foo.pubsub.a0", "bar.pubsub.a0"
-        ]
-        assert (announcement["read_abspath"] ==
-                f"{os.environ['A0_ROOT']}/{announcement['read_relpath']}")
-        assert announcement["write_relpath"] == pytest_regex(
-            f"\\d{{4}}/\\d{{2}}/\\d{{2}}/{announcement['read_relpath']}@\\d{{4}}-\\d{{2}}-\\d{{2}}T\\d{{2}}:\\d{{2}}:\\d{{2}}.\\d{{9}}-\\d{{2}}:\\d{{2}}.a0"  # noqa: E501
-        )
-        assert announcement["write_abspath"] == pytest_regex(
-            f"{sandbox.savepath.name}/{announcement['write_relpath']}")
-        topic_counter[announcement["read_relpath"]] += 1
-
-    assert topic_counter == {"foo.pubsub.a0": 6, "bar.pubsub.a0": 4}
+    assert 9 <= len(sandbox.logged_packets()["foo"]) <= 11
 
 
-def test_start_time_mono(sandbox):
+def test_trigger_min_interval(sandbox):
     foo = a0.Publisher("foo")
-    foo.pub("msg 0")
 
     sandbox.start({
         "savepath":
             sandbox.savepath.name,
-        "start_time_mono":
-            str(a0.TimeMono.now()),
         "rules": [{
-            "protocol": "pubsub",
-            "topic": "foo",
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
             "policies": [{
-                "type": "save_all"
+                "type": "count",
+                "args": {
+                    "save_next": 1,
+                },
+                "min_interval": "1s",
+                "triggers": [{
+                    "type": "rate",
+                    "args": {
+                        "hz": 20,
+                    },
+                }],
             }],
         }],
     })
 
-    foo.pub("msg 1")
+    for i in range(30):
+        foo.pub(f"foo_{i}")
+        time.sleep(0.1)
+
     time.sleep(0.5)
 
     sandbox.shutdown()
-    assert sandbox.logged_packets()["foo"] == ["msg 1"]
 
+    # Without min_interval, nearly every packet would be saved.
+    assert 2 <= len(sandbox.logged_packets()["foo"]) <= 5
 
-def test_trigger_control(sandbox):
+
+def test_trigger_cron(sandbox):
     foo = a0.Publisher("foo")
-    bar = a0.Publisher("bar")
-    trigger_controls = [a0.Publisher(f"trigger_control_{i}") for i in range(3)]
 
     sandbox.start({
         "savepath":
@@ -487,60 +483,1347 @@ def test_trigger_control(sandbox):
                 "pubsub",
             "topic":
                 "foo",
-            "trigger_control_topic":
-                "trigger_control_0",
             "policies": [{
                 "type":
                     "count",
                 "args": {
-                    "save_prev": 1,
+                    "save_next": 1,
                 },
-                "trigger_control_topic":
-                    "trigger_control_1",
                 "triggers": [{
-                    "type": "pubsub",
+                    "type": "cron",
                     "args": {
-                        "topic": "bar",
+                        "pattern": "*/2 * * * * *",
                     },
-                    "control_topic": "trigger_control_2",
                 }],
             }],
         }],
     })
 
-    foo.pub("foo_0")
-    time.sleep(0.5)
-
-    bar.pub("save_0")
-    time.sleep(0.5)
-
-    trigger_controls[0].pub("on")
-    time.sleep(0.5)
-
-    foo.pub("foo_1")
-    time.sleep(0.5)
-
-    bar.pub("save_1")
-    time.sleep(0.5)
+    for i in range(20):
+        foo.pub(f"foo_{i}")
+        time.sleep(0.25)
 
-    trigger_controls[1].pub("on")
     time.sleep(0.5)
 
-    foo.pub("foo_2")
-    time.sleep(0.5)
+    sandbox.shutdown()
 
-    bar.pub("save_2")
-    time.sleep(0.5)
+    assert len(sandbox.logged_packets()["foo"]) in [3, 4]
 
-    trigger_controls[2].pub("off")
-    time.sleep(0.5)
 
-    foo.pub("foo_3")
-    time.sleep(0.5)
+def test_trigger_predicate(sandbox):
+    foo = a0.Publisher("foo")
+    telemetry = a0.Publisher("telemetry")
 
-    bar.pub("save_3")
-    time.sleep(0.5)
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "policies": [{
+                "type":
+                    "count",
+                "args": {
+                    "save_prev": 1,
+                },
+                "triggers": [{
+                    "type": "predicate",
+                    "args": {
+                        "topic": "telemetry",
+                        "predicate": "speed > 20 && state.mode != \"manual\"",
+                    },
+                }],
+            }],
+        }],
+    })
+
+    for i, (speed, mode) in enumerate([
+        (10, "auto"),
+        (25, "manual"),
+        (25, "auto"),
+        (30, "auto"),
+        (5, "auto"),
+        (21, "auto"),
+    ]):
+        foo.pub(f"foo_{i}")
+        time.sleep(0.1)
+        telemetry.pub(json.dumps({"speed": speed, "state": {"mode": mode}}))
+        time.sleep(0.1)
+
+    sandbox.shutdown()
+
+    # Edge triggered: fires at i=2 and i=5, not at i=3.
+    assert sandbox.logged_packets() == {"foo": ["foo_2", "foo_5"]}
+
+
+def test_trigger_shared_subscriber(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+    telemetry = a0.Publisher("telemetry")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "stats_period":
+            "100ms",
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "policies": [{
+                "type":
+                    "count",
+                "args": {
+                    "save_prev": 1,
+                },
+                "triggers": [{
+                    "type": "pubsub",
+                    "args": {
+                        "topic": "telemetry",
+                    },
+                }],
+            }],
+        }, {
+            "protocol":
+                "pubsub",
+            "topic":
+                "bar",
+            "policies": [{
+                "type":
+                    "count",
+                "args": {
+                    "save_prev": 1,
+                },
+                "triggers": [{
+                    "type": "predicate",
+                    "args": {
+                        "topic": "telemetry",
+                        "predicate": "speed > 20",
+                    },
+                }],
+            }],
+        }],
+    })
+
+    stats = []
+
+    def on_stats(pkt):
+        stats.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+    foo.pub("foo_0")
+    bar.pub("bar_0")
+    time.sleep(0.1)
+    telemetry.pub(json.dumps({"speed": 25}))
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    assert sandbox.logged_packets() == {"foo": ["foo_0"], "bar": ["bar_0"]}
+    # Both triggers read telemetry through one subscriber.
+    summary = [s for s in stats if "topics" in s][-1]
+    assert summary["trigger_subscribers"] == 1
+
+
+def test_scheduling_at_startup(sandbox):
+    foo = a0.Publisher("foo")  # noqa: F841
+
+    announcements = []
+
+    def on_announce(pkt):
+        announcements.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/announce", a0.INIT_OLDEST, on_announce)
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "scheduling": {
+            "nice": 5,
+        },
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "policies": [{
+                "type": "save_all",
+                "triggers": [{
+                    "type": "rate",
+                    "args": {
+                        "period": 3600,
+                    },
+                }],
+            }],
+        }],
+    })
+
+    sandbox.shutdown()
+
+    # Reported before any packet arrives.
+    scheduled = {
+        a["thread"]: a["effective"]
+        for a in announcements
+        if a["action"] == "scheduled"
+    }
+    assert scheduled.keys() == {"reader", "trigger"}
+    assert scheduled["reader"]["nice"] == 5
+    assert scheduled["trigger"]["nice"] == 5
+
+
+def test_scheduling_shared_trigger(sandbox):
+    foo = a0.Publisher("foo")  # noqa: F841
+
+    announcements = []
+
+    def on_announce(pkt):
+        announcements.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/announce", a0.INIT_OLDEST, on_announce)
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "scheduling": {
+            "nice": 5,
+        },
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "scheduling": {
+                "nice": 10,
+            },
+            "policies": [{
+                "type":
+                    "save_all",
+                "triggers": [{
+                    "type": "pubsub",
+                    "args": {
+                        "topic": "telemetry",
+                    },
+                }],
+            }],
+        }],
+    })
+
+    sandbox.shutdown()
+
+    scheduled = {
+        a["thread"]: a["effective"]
+        for a in announcements
+        if a["action"] == "scheduled"
+    }
+    # The trigger subscriber may serve other rules, so keeps the global nice.
+    assert scheduled.keys() == {"reader", "trigger_subscriber"}
+    assert scheduled["reader"]["nice"] == 10
+    assert scheduled["trigger_subscriber"]["nice"] == 5
+    assert [a["action"] for a in announcements].count("warning") == 1
+
+
+def test_max_logfile_size(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "default_max_logfile_size":
+            "2MiB",
+        "rules": [
+            {
+                "protocol": "pubsub",
+                "topic": "foo",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+            {
+                "protocol": "pubsub",
+                "topic": "bar",
+                "max_logfile_size": "4MiB",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+        ],
+    })
+
+    announcements = []
+
+    def on_announce(pkt):
+        announcements.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa:F841
+        "test/announce", a0.INIT_OLDEST, on_announce)
+
+    msg = "a" * (1024 * 1024 // 2 - 1024)  # Half a megabyte minus epsilon.
+    for _ in range(16):
+        foo.pub(msg)
+        bar.pub(msg)
+
+    time.sleep(1)
+
+    sandbox.shutdown()
+
+    topic_counter = {"foo.pubsub.a0": 0, "bar.pubsub.a0": 0}
+    for announcement in announcements:
+        assert announcement["action"] in ["opened", "closed"]
+        assert announcement["read_relpath"] in [
+            "foo.pubsub.a0", "bar.pubsub.a0"
+        ]
+        assert (announcement["read_abspath"] ==
+                f"{os.environ['A0_ROOT']}/{announcement['read_relpath']}")
+        assert announcement["write_relpath"] == pytest_regex(
+            f"\\d{{4}}/\\d{{2}}/\\d{{2}}/{announcement['read_relpath']}@\\d{{4}}-\\d{{2}}-\\d{{2}}T\\d{{2}}:\\d{{2}}:\\d{{2}}.\\d{{9}}-\\d{{2}}:\\d{{2}}.a0"  # noqa: E501
+        )
+        assert announcement["write_abspath"] == pytest_regex(
+            f"{sandbox.savepath.name}/{announcement['write_relpath']}")
+        topic_counter[announcement["read_relpath"]] += 1
+
+    assert topic_counter == {"foo.pubsub.a0": 8, "bar.pubsub.a0": 4}
+
+
+def test_max_logfile_duration(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "default_max_logfile_duration":
+            "2s",
+        "rules": [
+            {
+                "protocol": "pubsub",
+                "topic": "foo",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+            {
+                "protocol": "pubsub",
+                "topic": "bar",
+                "max_logfile_duration": "4s",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+        ],
+    })
+
+    announcements = []
+
+    def on_announce(pkt):
+        announcements.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/announce", a0.INIT_OLDEST, on_announce)
+
+    msg = "msg"
+    for _ in range(10):
+        foo.pub(msg)
+        bar.pub(msg)
+        time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    topic_counter = {"foo.pubsub.a0": 0, "bar.pubsub.a0": 0}
+    for announcement in announcements:
+        assert announcement["action"] in ["opened", "closed"]
+        assert announcement["read_relpath"] in [
+            "foo.pubsub.a0", "bar.pubsub.a0"
+        ]
+        assert (announcement["read_abspath"] ==
+                f"{os.environ['A0_ROOT']}/{announcement['read_relpath']}")
+        assert announcement["write_relpath"] == pytest_regex(
+            f"\\d{{4}}/\\d{{2}}/\\d{{2}}/{announcement['read_relpath']}@\\d{{4}}-\\d{{2}}-\\d{{2}}T\\d{{2}}:\\d{{2}}:\\d{{2}}.\\d{{9}}-\\d{{2}}:\\d{{2}}.a0"  # noqa: E501
+        )
+        assert announcement["write_abspath"] == pytest_regex(
+            f"{sandbox.savepath.name}/{announcement['write_relpath']}")
+        topic_counter[announcement["read_relpath"]] += 1
+
+    assert topic_counter == {"foo.pubsub.a0": 6, "bar.pubsub.a0": 4}
+
+
+def test_start_time_mono(sandbox):
+    foo = a0.Publisher("foo")
+    foo.pub("msg 0")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "start_time_mono":
+            str(a0.TimeMono.now()),
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    foo.pub("msg 1")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+    assert sandbox.logged_packets()["foo"] == ["msg 1"]
+
+
+def test_trigger_control(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+    trigger_controls = [a0.Publisher(f"trigger_control_{i}") for i in range(3)]
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [{
+            "protocol":
+                "pubsub",
+            "topic":
+                "foo",
+            "trigger_control_topic":
+                "trigger_control_0",
+            "policies": [{
+                "type":
+                    "count",
+                "args": {
+                    "save_prev": 1,
+                },
+                "trigger_control_topic":
+                    "trigger_control_1",
+                "triggers": [{
+                    "type": "pubsub",
+                    "args": {
+                        "topic": "bar",
+                    },
+                    "control_topic": "trigger_control_2",
+                }],
+            }],
+        }],
+    })
+
+    foo.pub("foo_0")
+    time.sleep(0.5)
+
+    bar.pub("save_0")
+    time.sleep(0.5)
+
+    trigger_controls[0].pub("on")
+    time.sleep(0.5)
+
+    foo.pub("foo_1")
+    time.sleep(0.5)
+
+    bar.pub("save_1")
+    time.sleep(0.5)
+
+    trigger_controls[1].pub("on")
+    time.sleep(0.5)
+
+    foo.pub("foo_2")
+    time.sleep(0.5)
+
+    bar.pub("save_2")
+    time.sleep(0.5)
+
+    trigger_controls[2].pub("off")
+    time.sleep(0.5)
+
+    foo.pub("foo_3")
+    time.sleep(0.5)
+
+    bar.pub("save_3")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    assert sandbox.logged_packets() == {"foo": ["foo_1", "foo_2"]}
+
+
+def test_encoding_compact(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [
+            {
+                "protocol": "pubsub",
+                "topic": "foo",
+                "encoding": "compact",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+            {
+                "protocol": "pubsub",
+                "topic": "bar",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+        ],
+    })
+
+    for i in range(100):
+        foo.pub(f"msg_{i}")
+        bar.pub(f"msg_{i}")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    paths = {}
+    for path in glob.glob(os.path.join(sandbox.savepath.name, "**/*@*.a0"),
+                          recursive=True):
+        paths[path.split("/")[-1].split(".")[0]] = path
+
+    assert os.path.getsize(paths["foo"]) < os.path.getsize(paths["bar"])
+
+    reader = a0.ReaderSync(a0.File(paths["foo"]), a0.INIT_OLDEST)
+    for i in range(100):
+        pkt = reader.read()
+        assert pkt.headers == [("a0_enc", "compact1")]
+        assert pkt.payload.endswith(f"msg_{i}".encode())
+    assert not reader.can_read()
+
+
+def test_reconfigure(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+
+    cfg = {
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [
+            {
+                "protocol": "pubsub",
+                "topic": "foo",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+            {
+                "protocol": "pubsub",
+                "topic": "bar",
+                "policies": [{
+                    "type": "drop_all"
+                }],
+            },
+        ],
+    }
+    sandbox.start(cfg)
+
+    announcements = []
+
+    def on_announce(pkt):
+        announcements.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/announce", a0.INIT_OLDEST, on_announce)
+
+    foo.pub("foo_0")
+    bar.pub("bar_0")
+    time.sleep(0.5)
+
+    cfg["rules"][1]["policies"] = [{"type": "save_all"}]
+    a0.Cfg("test").write(json.dumps(cfg))
+    time.sleep(0.5)
+
+    foo.pub("foo_1")
+    bar.pub("bar_1")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    assert sandbox.logged_packets() == {
+        "foo": ["foo_0", "foo_1"],
+        "bar": ["bar_1"],
+    }
+    assert [a["action"] for a in announcements].count("reconfigured") == 1
+    # foo's FileLogger was untouched, so it kept a single logfile.
+    foo_opened = [
+        a for a in announcements
+        if a["action"] == "opened" and a["read_relpath"] == "foo.pubsub.a0"
+    ]
+    assert len(foo_opened) == 1
+
+
+def test_reconfigure_while_logging(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+
+    cfg = {
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [
+            {
+                "protocol": "pubsub",
+                "topic": "foo",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+            {
+                "protocol": "pubsub",
+                "topic": "bar",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+        ],
+    }
+    sandbox.start(cfg)
+
+    # Both topics publish throughout, while bar's rule is replaced twice.
+    publishing = True
+
+    def publish():
+        i = 0
+        while publishing:
+            foo.pub(f"foo_{i}")
+            bar.pub(f"bar_{i}")
+            i += 1
+            time.sleep(0.005)
+        return i
+
+    result = []
+    t = threading.Thread(target=lambda: result.append(publish()))
+    t.start()
+    time.sleep(0.5)
+
+    cfg["rules"][1]["priority"] = 1
+    a0.Cfg("test").write(json.dumps(cfg))
+    time.sleep(0.5)
+    cfg["rules"][1]["priority"] = 2
+    a0.Cfg("test").write(json.dumps(cfg))
+    time.sleep(0.5)
+
+    publishing = False
+    t.join()
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    # foo was never interrupted.
+    assert sandbox.logged_packets()["foo"] == [
+        f"foo_{i}" for i in range(result[0])
+    ]
+
+    # bar has a logfile per rule, each resuming where the last left off.
+    # Logfile names end in their start time, so they sort in order.
+    bar_pkts = []
+    for path in sorted(
+            glob.glob(os.path.join(sandbox.savepath.name, "**/bar*@*.a0"),
+                      recursive=True)):
+        reader = a0.ReaderSync(a0.File(path), a0.INIT_OLDEST)
+        while reader.can_read():
+            bar_pkts.append(reader.read().payload.decode())
+    assert bar_pkts == [f"bar_{i}" for i in range(result[0])]
+
+
+def test_shutdown_stats(sandbox):
+    foo = a0.Publisher("foo")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "shutdown_timeout":
+            "5s",
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    stats = []
+
+    def on_stats(pkt):
+        stats.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+    foo.pub("foo_0")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+    time.sleep(0.1)
+
+    assert sandbox.logged_packets() == {"foo": ["foo_0"]}
+    shutdown = [s["shutdown"] for s in stats if "shutdown" in s]
+    assert len(shutdown) == 1
+    assert shutdown[0]["file_loggers"] == 1
+    assert shutdown[0]["timed_out"] == 0
+
+
+def test_replay(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "*",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    for i in range(10):
+        foo.pub(f"foo_{i}")
+        bar.pub(f"bar_{i}")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    with tempfile.TemporaryDirectory(prefix="/dev/shm/") as dest:
+        subprocess.run(
+            [
+                "bin/log_replay",
+                "--savepath",
+                sandbox.savepath.name,
+                "--topic",
+                "foo*",
+                "--speed",
+                "max",
+                "--dest",
+                dest,
+            ],
+            check=True,
+        )
+
+        assert os.listdir(dest) == ["foo.pubsub.a0"]
+        reader = a0.ReaderSync(a0.File(os.path.join(dest, "foo.pubsub.a0")),
+                               a0.INIT_OLDEST)
+        replayed = []
+        while reader.can_read():
+            replayed.append(reader.read().payload.decode())
+        assert replayed == [f"foo_{i}" for i in range(10)]
+
+
+def test_replay_time_range(sandbox):
+    foo = a0.Publisher("foo")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    for i in range(10):
+        foo.pub(f"foo_{i}")
+        time.sleep(0.01)
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    [logfile] = glob.glob(os.path.join(sandbox.savepath.name, "**/*@*.a0"),
+                          recursive=True)
+    reader = a0.ReaderSync(a0.File(logfile), a0.INIT_OLDEST)
+    walls = []
+    while reader.can_read():
+        walls.append(dict(reader.read().headers)["a0_time_wall"])
+
+    with tempfile.TemporaryDirectory(prefix="/dev/shm/") as dest:
+        subprocess.run(
+            [
+                "bin/log_replay",
+                "--savepath",
+                sandbox.savepath.name,
+                "--start",
+                walls[5],
+                "--end",
+                walls[7],
+                "--speed",
+                "max",
+                "--dest",
+                dest,
+            ],
+            check=True,
+        )
+
+        reader = a0.ReaderSync(a0.File(os.path.join(dest, "foo.pubsub.a0")),
+                               a0.INIT_OLDEST)
+        replayed = []
+        while reader.can_read():
+            replayed.append(reader.read().payload.decode())
+        assert replayed == ["foo_5", "foo_6", "foo_7"]
+
+
+def test_replay_bad_time():
+    with tempfile.TemporaryDirectory(prefix="/dev/shm/") as savepath:
+        out = subprocess.run(
+            [
+                "bin/log_replay",
+                "--savepath",
+                savepath,
+                "--start",
+                "yesterday",
+            ],
+            capture_output=True,
+            text=True,
+        )
+        assert out.returncode == 1
+        assert "Invalid --start: yesterday" in out.stderr
+        assert "Usage:" in out.stderr
+
+
+def test_loadgen():
+    with tempfile.TemporaryDirectory(prefix="/dev/shm/") as tmp_root:
+        os.environ["A0_ROOT"] = tmp_root
+        out = subprocess.run(
+            [
+                "bin/log_loadgen",
+                "--topics",
+                "2",
+                "--publishers",
+                "4",
+                "--rate",
+                "100",
+                "--payload",
+                "uniform:16:4096",
+                "--duration",
+                "2",
+            ],
+            check=True,
+            capture_output=True,
+            text=True,
+        ).stdout
+
+    assert "missing:           0 pkts" in out
+    assert "out of order:      0" in out
+
+
+def test_staging_path(sandbox):
+    foo = a0.Publisher("foo")
+
+    with tempfile.TemporaryDirectory(prefix="/dev/shm/") as staging_path:
+        sandbox.start({
+            "savepath":
+                sandbox.savepath.name,
+            "staging_path":
+                staging_path,
+            "rules": [{
+                "protocol": "pubsub",
+                "topic": "foo",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            }],
+        })
+
+        for i in range(10):
+            foo.pub(f"foo_{i}")
+        time.sleep(0.5)
+
+        sandbox.shutdown()
+
+        assert sandbox.logged_packets() == {
+            "foo": [f"foo_{i}" for i in range(10)],
+        }
+        assert glob.glob(os.path.join(staging_path, "**/*.a0"),
+                         recursive=True) == []
+        # The migration journal is removed once there's nothing left to copy.
+        assert not os.path.exists(
+            os.path.join(sandbox.savepath.name, ".migrating"))
+
+
+def test_staging_path_retry(sandbox):
+    foo = a0.Publisher("foo")
+
+    # A file where the dated directory belongs makes every copy fail.
+    blocker = os.path.join(sandbox.savepath.name,
+                           datetime.datetime.utcnow().strftime("%Y"))
+    with open(blocker, "w") as f:
+        f.write("blocker")
+
+    with tempfile.TemporaryDirectory(prefix="/dev/shm/") as staging_path:
+        sandbox.start({
+            "savepath":
+                sandbox.savepath.name,
+            "staging_path":
+                staging_path,
+            "stats_period":
+                "100ms",
+            "default_max_logfile_size":
+                "1MiB",
+            "rules": [{
+                "protocol": "pubsub",
+                "topic": "foo",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            }],
+        })
+
+        stats = []
+
+        def on_stats(pkt):
+            stats.append(json.loads(pkt.payload.decode()))
+
+        s = a0.Subscriber(  # noqa: F841
+            "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+        msg = "a" * (400 * 1024)
+        for i in range(6):
+            foo.pub(f"{i}_{msg}")
+        time.sleep(0.5)
+
+        # Closed logfiles wait in staging.
+        migrator_stats = [s for s in stats if "migrator" in s][-1]["migrator"]
+        assert migrator_stats["retrying"] >= 1
+        assert glob.glob(os.path.join(staging_path, "**/*.a0"),
+                         recursive=True) != []
+
+        # Once the outage passes, they are migrated without a restart.
+        os.remove(blocker)
+        time.sleep(3)
+
+        migrator_stats = [s for s in stats if "migrator" in s][-1]["migrator"]
+        assert migrator_stats == {"queued": 0, "retrying": 0}
+        assert glob.glob(os.path.join(staging_path, "**/*.a0"),
+                         recursive=True) == []
+
+        sandbox.shutdown()
+
+
+def test_staging_path_recover_after_crash(sandbox):
+    foo = a0.Publisher("foo")
+
+    with tempfile.TemporaryDirectory(prefix="/dev/shm/") as staging_path:
+        cfg = {
+            "savepath":
+                sandbox.savepath.name,
+            "staging_path":
+                staging_path,
+            "rules": [{
+                "protocol": "pubsub",
+                "topic": "foo",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            }],
+        }
+        sandbox.start(cfg)
+
+        for i in range(10):
+            foo.pub(f"foo_{i}")
+        time.sleep(0.5)
+
+        sandbox.kill()
+
+        # The logfile was cut off in progress.
+        assert len(
+            glob.glob(os.path.join(staging_path, "**/.*.a0"),
+                      recursive=True)) == 1
+
+        # Don't record the same packets again.
+        cfg["start_time_mono"] = str(a0.TimeMono.now())
+        sandbox.start(cfg)
+        sandbox.shutdown()
+
+        assert sandbox.logged_packets() == {
+            "foo": [f"foo_{i}" for i in range(10)],
+        }
+        assert glob.glob(os.path.join(staging_path, "**/*.a0"),
+                         recursive=True) == []
+        assert glob.glob(os.path.join(staging_path, "**/.*.a0"),
+                         recursive=True) == []
+
+
+def test_stats_lost(sandbox):
+    # A raw Writer lets us forge gaps in the transport sequence,
+    # as if the arena had evicted packets before the logger read them.
+    foo = a0.Writer(a0.File("foo.pubsub.a0"))
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "stats_period":
+            "100ms",
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    stats = []
+
+    def on_stats(pkt):
+        stats.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+    for seq in [0, 1, 2, 5, 6, 10]:
+        foo.write(
+            a0.Packet(
+                [
+                    ("a0_time_mono", str(a0.TimeMono.now())),
+                    ("a0_time_wall", str(a0.TimeWall.now())),
+                    ("a0_transport_seq", str(seq)),
+                ],
+                f"foo_{seq}",
+            ))
+    time.sleep(0.5)
 
     sandbox.shutdown()
 
-    assert sandbox.logged_packets() == {"foo": ["foo_1", "foo_2"]}
+    topic_stats = [s for s in stats if "topics" in s][-1]["topics"][0]
+    assert topic_stats["read_relpath"] == "foo.pubsub.a0"
+    assert topic_stats["received"] == 6
+    assert topic_stats["lost"] == 5
+    assert topic_stats["shed"] == 0
+    # Every packet read takes its buffer from the pool.
+    assert topic_stats["pool"]["misses"] >= 1
+    assert topic_stats["pool"]["hits"] + topic_stats["pool"]["misses"] == 6
+
+
+def test_stats_bad_seq(sandbox):
+    foo = a0.Writer(a0.File("foo.pubsub.a0"))
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "stats_period":
+            "100ms",
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    stats = []
+
+    def on_stats(pkt):
+        stats.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+    # Malformed sequence numbers are saved, but not counted towards loss.
+    seqs = ["0", "abc", "99999999999999999999999", "-1", "", "1", "3"]
+    for i, seq in enumerate(seqs):
+        foo.write(
+            a0.Packet(
+                [
+                    ("a0_time_mono", str(a0.TimeMono.now())),
+                    ("a0_time_wall", str(a0.TimeWall.now())),
+                    ("a0_transport_seq", seq),
+                ],
+                f"foo_{i}",
+            ))
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    assert sandbox.logged_packets() == {
+        "foo": [f"foo_{i}" for i in range(len(seqs))]
+    }
+    topic_stats = [s for s in stats if "topics" in s][-1]["topics"][0]
+    assert topic_stats["received"] == len(seqs)
+    assert topic_stats["lost"] == 1
+
+
+def test_io_budget(sandbox):
+    foo = a0.Publisher("foo")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "stats_period":
+            "100ms",
+        "shutdown_timeout":
+            "10s",
+        "io_budget":
+            "20KiB",
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    stats = []
+
+    def on_stats(pkt):
+        stats.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+    payload = "x" * 1024
+    for i in range(100):
+        foo.pub(f"foo_{i}_{payload}")
+    time.sleep(1)
+
+    # About a second of budget, plus the burst, has been written.
+    written = len(sandbox.logged_packets().get("foo", []))
+    assert 5 <= written <= 40
+    topic_stats = [s for s in stats if "topics" in s][-1]["topics"][0]
+    assert topic_stats["io_pending"] > 0
+    assert topic_stats["io_bypassed"] == 0
+
+    # The rest is written on shutdown.
+    sandbox.shutdown()
+    assert sandbox.logged_packets() == {
+        "foo": [f"foo_{i}_{payload}" for i in range(100)]
+    }
+
+
+def test_io_weight(sandbox):
+    foo = a0.Publisher("foo")
+    bar = a0.Publisher("bar")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "io_budget":
+            "40KiB",
+        "rules": [
+            {
+                "protocol": "pubsub",
+                "topic": "foo",
+                "io_weight": 3,
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+            {
+                "protocol": "pubsub",
+                "topic": "bar",
+                "policies": [{
+                    "type": "save_all"
+                }],
+            },
+        ],
+    })
+
+    payload = "x" * 1024
+    for i in range(100):
+        foo.pub(f"foo_{i}_{payload}")
+        bar.pub(f"bar_{i}_{payload}")
+    time.sleep(1.5)
+
+    # Both are backlogged, so they split the budget 3:1.
+    pkts = sandbox.logged_packets()
+    num_foo = len(pkts.get("foo", []))
+    num_bar = len(pkts.get("bar", []))
+    assert num_bar > 0
+    assert num_foo < 100
+    assert 2 * num_bar <= num_foo <= 4 * num_bar
+
+
+def test_io_max_pending(sandbox):
+    foo = a0.Publisher("foo")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "stats_period":
+            "100ms",
+        "io_budget":
+            "1KiB",
+        "io_max_pending":
+            "4KiB",
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    stats = []
+
+    def on_stats(pkt):
+        stats.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+    payload = "x" * 1024
+    for i in range(20):
+        foo.pub(f"foo_{i}_{payload}")
+    time.sleep(0.5)
+
+    # Far over budget, but whenever more than 4KiB waits, it all goes out.
+    written = len(sandbox.logged_packets().get("foo", []))
+    assert written >= 16
+    topic_stats = [s for s in stats if "topics" in s][-1]["topics"][0]
+    assert topic_stats["io_bypassed"] >= 16 * 1024
+    assert topic_stats["io_pending"] <= 4 * 1024
+
+    sandbox.shutdown()
+    assert sandbox.logged_packets() == {
+        "foo": [f"foo_{i}_{payload}" for i in range(20)]
+    }
+
+
+def test_startup_many_topics(sandbox):
+    # Topics that exist before the logger starts are all picked up at once.
+    pubs = [a0.Publisher(f"topic_{i}") for i in range(50)]
+    for i, pub in enumerate(pubs):
+        pub.pub(f"topic_{i}_before")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "stats_period":
+            "100ms",
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "*",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    stats = []
+
+    def on_stats(pkt):
+        stats.append(json.loads(pkt.payload.decode()))
+
+    s = a0.Subscriber(  # noqa: F841
+        "test/stats", a0.INIT_AWAIT_NEW, on_stats)
+
+    for i, pub in enumerate(pubs):
+        pub.pub(f"topic_{i}_after")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    assert sandbox.logged_packets() == {
+        f"topic_{i}": [f"topic_{i}_before", f"topic_{i}_after"]
+        for i in range(50)
+    }
+
+    topic_stats = [s for s in stats if "topics" in s][-1]["topics"]
+    assert len(topic_stats) == 50
+    for t in topic_stats:
+        assert t["first_packet_ms"] is not None
+        assert t["first_packet_ms"] >= 0
+
+
+def test_verify(sandbox):
+    foo = a0.Publisher("foo")
+
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    for i in range(10):
+        foo.pub(f"foo_{i}")
+    time.sleep(0.5)
+
+    sandbox.shutdown()
+
+    logfiles = glob.glob(os.path.join(sandbox.savepath.name, "**/*.a0"),
+                         recursive=True)
+    assert len(logfiles) == 1
+    assert os.path.exists(logfiles[0] + ".crc")
+
+    verify = subprocess.run(
+        ["bin/log_verify", "--strict", sandbox.savepath.name],
+        capture_output=True,
+        text=True,
+    )
+    assert verify.returncode == 0
+    assert "0 bad" in verify.stdout
+
+    # Flip a byte.
+    with open(logfiles[0], "r+b") as f:
+        f.seek(100)
+        byte = f.read(1)
+        f.seek(100)
+        f.write(bytes([byte[0] ^ 0xFF]))
+
+    verify = subprocess.run(
+        ["bin/log_verify", sandbox.savepath.name],
+        capture_output=True,
+        text=True,
+    )
+    assert verify.returncode == 1
+    assert f"BAD      {logfiles[0]}: [0, " in verify.stdout
+
+
+def test_verify_multi_block(sandbox):
+    foo = a0.Publisher("foo")
+
+    # Logfiles span several 1MiB checksum blocks, and roll over.
+    sandbox.start({
+        "savepath":
+            sandbox.savepath.name,
+        "default_max_logfile_size":
+            "5MiB",
+        "rules": [{
+            "protocol": "pubsub",
+            "topic": "foo",
+            "policies": [{
+                "type": "save_all"
+            }],
+        }],
+    })
+
+    msg = "a" * (300 * 1024)
+    for i in range(40):
+        foo.pub(f"{i}_{msg}")
+    time.sleep(1)
+
+    sandbox.shutdown()
+
+    logfiles = glob.glob(os.path.join(sandbox.savepath.name, "**/*.a0"),
+                         recursive=True)
+    assert len(logfiles) >= 3
+    for logfile in logfiles:
+        assert os.path.exists(logfile + ".crc")
+
+    verify = subprocess.run(
+        ["bin/log_verify", "--strict", sandbox.savepath.name],
+        capture_output=True,
+        text=True,
+    )
+    assert verify.returncode == 0
+    assert "0 bad, 0 without checksums" in verify.stdout
@@ -0,0 +1,258 @@
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "a0/logger/block_checksums.hpp"
+#include "a0/logger/thread_pool.hpp"
+
+// Checks saved logfiles against their checksum sidecars.
+//
+// Directories are searched recursively for logfiles. Each file is mapped and
+// checked on a pool of threads, largest first. Damaged files are listed with
+// the byte ranges that don't match.
+//
+// Usage:
+//   bin/log_verify [--jobs <N>] [--strict] <path>...
+//
+// Exits nonzero if any logfile is damaged or unreadable, or, with --strict,
+// lacks a sidecar.
+
+namespace a0::logger {
+
+struct VerifyConfig {
+  std::vector<std::filesystem::path> paths;
+  size_t jobs{ThreadPool::default_size()};
+  bool strict{false};
+};
+
+class Verify {
+  enum class Status {
+    OK,
+    BAD,
+    NO_CHECKSUMS,
+    ERROR,
+  };
+
+  struct Result {
+    std::filesystem::path path;
+    uint64_t size{0};
+    Status status{Status::OK};
+    std::vector<BlockChecksums::Range> bad;
+    uint64_t expected_size{0};
+    std::string error;
+    // A directory that couldn't be listed, rather than a logfile.
+    bool is_dir{false};
+  };
+
+  VerifyConfig config;
+
+  static bool is_logfile(const std::filesystem::path& path) {
+    return std::string(path.filename()).rfind(".", 0) != 0 && path.extension() == ".a0";
+  }
+
+  // Directories that can't be listed are reported as unreadable. The rest of
+  // the tree is still searched.
+  std::vector<Result> find_logfiles() {
+    std::vector<Result> found;
+    auto add = [&](const std::filesystem::path& path, uint64_t size) {
+      found.emplace_back();
+      found.back().path = path;
+      found.back().size = size;
+    };
+    auto add_error = [&](const std::filesystem::path& path, const std::error_code& ec) {
+      add(path, 0);
+      found.back().status = Status::ERROR;
+      found.back().error = ec.message();
+      found.back().is_dir = true;
+    };
+
+    std::vector<std::filesystem::path> dirs;
+    for (auto&& path : config.paths) {
+      std::error_code ec;
+      if (std::filesystem::is_directory(path, ec)) {
+        dirs.push_back(path);
+      } else {
+        add(path, 0);
+      }
+    }
+    while (!dirs.empty()) {
+      auto dir = std::move(dirs.back());
+      dirs.pop_back();
+
+      std::error_code ec;
+      std::filesystem::directory_iterator it(dir, ec);
+      if (ec) {
+        add_error(dir, ec);
+        continue;
+      }
+      for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        auto&& entry = *it;
+        std::error_code entry_ec;
+        if (entry.is_directory(entry_ec) && !entry.is_symlink(entry_ec)) {
+          dirs.push_back(entry.path());
+        } else if (entry.is_regular_file(entry_ec) && is_logfile(entry.path())) {
+          uint64_t size = entry.file_size(entry_ec);
+          add(entry.path(), entry_ec ? 0 : size);
+        }
+      }
+      if (ec) {
+        add_error(dir, ec);
+      }
+    }
+    return found;
+  }
+
+  static void check(Result& result) {
+    if (result.status == Status::ERROR) {
+      return;
+    }
+    try {
+      MappedFile file(result.path);
+      result.size = file.size();
+      std::error_code ec;
+      auto sidecar = BlockChecksums::sidecar_path(result.path);
+      if (!std::filesystem::exists(sidecar, ec)) {
+        result.status = Status::NO_CHECKSUMS;
+        return;
+      }
+      auto expected = BlockChecksums::load(sidecar);
+      result.expected_size = expected.file_size;
+      result.bad = expected.mismatches(file.data(), file.size());
+      result.status = result.bad.empty() ? Status::OK : Status::BAD;
+    } catch (const std::exception& e) {
+      result.status = Status::ERROR;
+      result.error = e.what();
+    }
+  }
+
+ public:
+  explicit Verify(VerifyConfig config_)
+      : config{std::move(config_)} {}
+
+  // Returns the process exit code.
+  int run() {
+    auto start = std::chrono::steady_clock::now();
+
+    auto results = find_logfiles();
+    // Large files first, so one doesn't straggle at the end.
+    std::vector<Result*> order;
+    for (auto&& result : results) {
+      order.push_back(&result);
+    }
+    std::sort(order.begin(), order.end(), [](Result* a, Result* b) { return a->size > b->size; });
+    {
+      ThreadPool pool(config.jobs);
+      for (auto* result : order) {
+        pool.submit([result]() { check(*result); });
+      }
+      pool.wait();
+    }
+
+    std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) { return a.path < b.path; });
+    size_t num_bad = 0;
+    size_t num_unchecked = 0;
+    size_t num_errors = 0;
+    size_t num_logfiles = 0;
+    uint64_t total_bytes = 0;
+    for (auto&& result : results) {
+      num_logfiles += !result.is_dir;
+      total_bytes += result.size;
+      switch (result.status) {
+        case Status::OK: {
+          break;
+        }
+        case Status::BAD: {
+          num_bad++;
+          printf("BAD      %s:", result.path.c_str());
+          for (auto&& [begin, end] : result.bad) {
+            printf(" [%lu, %lu)", (unsigned long)begin, (unsigned long)end);
+          }
+          if (result.size != result.expected_size) {
+            printf(" size %lu, expected %lu", (unsigned long)result.size, (unsigned long)result.expected_size);
+          }
+          printf("\n");
+          break;
+        }
+        case Status::NO_CHECKSUMS: {
+          num_unchecked++;
+          printf("NO CRC   %s\n", result.path.c_str());
+          break;
+        }
+        case Status::ERROR: {
+          num_errors++;
+          printf("ERROR    %s: %s\n", result.path.c_str(), result.error.c_str());
+          break;
+        }
+      }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("Verified %zu logfiles, %.1f MiB in %.2fs (%.0f MiB/s). %zu bad, %zu without checksums, %zu unreadable.\n",
+           num_logfiles,
+           total_bytes / double(1 << 20),
+           elapsed.count(),
+           total_bytes / double(1 << 20) / std::max(elapsed.count(), 1e-9),
+           num_bad,
+           num_unchecked,
+           num_errors);
+
+    if (num_bad || num_errors || (config.strict && num_unchecked)) {
+      return 1;
+    }
+    return 0;
+  }
+};
+
+}  // namespace a0::logger
+
+static void usage(const char* argv0) {
+  fprintf(stderr, "Usage: %s [--jobs <N>] [--strict] <path>...\n", argv0);
+}
+
+int main(int argc, char** argv) {
+  a0::logger::VerifyConfig config;
+
+  static struct option long_opts[] = {
+      {"jobs", required_argument, 0, 'j'},
+      {"strict", no_argument, 0, 's'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_opts, nullptr)) != -1) {
+    switch (opt) {
+      case 'j': {
+        config.jobs = std::stoul(optarg);
+        if (!config.jobs) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      }
+      case 's': {
+        config.strict = true;
+        break;
+      }
+      default: {
+        usage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    config.paths.push_back(argv[i]);
+  }
+  if (config.paths.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  return a0::logger::Verify(config).run();
+}